@@ -0,0 +1,136 @@
+#include "client_event.h"
+
+#include <cuda.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "CUDA_samples/helper_cuda_drvapi.h"
+
+namespace weft {
+
+ClientEvent::ClientEvent(std::vector<Device> &devices) : devices_{devices} {
+  events_.reserve(devices.size());
+  for (auto &device : devices) {
+    checkCudaErrors(cuCtxSetCurrent(device));
+    CUevent event;
+    // Host waits block the thread rather than spin on a core
+    checkCudaErrors(cuEventCreate(&event, CU_EVENT_BLOCKING_SYNC));
+    events_.push_back(event);
+  }
+}
+
+ClientEvent::~ClientEvent() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    unused_.wait(lock, [this] { return queued_ == 0; });
+  }
+  for (size_t i = 0; i < events_.size(); ++i) {
+    checkCudaErrors(cuCtxSetCurrent(devices_[i]));
+    checkCudaErrors(cuEventDestroy(events_[i]));
+  }
+}
+
+std::shared_future<void> ClientEvent::recorded() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (recorded_.valid()) return recorded_;
+  // Like a CUevent never recorded, complete
+  std::promise<void> none;
+  none.set_value();
+  return none.get_future().share();
+}
+
+void ClientEvent::enqueue(ClientStream &stream, ClientStream::Work work) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++queued_;
+  }
+  stream.enqueue([this, work = std::move(work)] {
+    work();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--queued_ == 0) unused_.notify_all();
+  });
+}
+
+void ClientEvent::record(ClientStream &stream) {
+  auto done = std::make_shared<std::promise<void>>();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    recorded_ = done->get_future().share();
+  }
+
+  enqueue(stream, [this, &stream, done] {
+    std::vector<std::future<void>> records;
+    for (size_t i = 0; i < events_.size(); ++i) {
+      records.push_back(stream.submit(i, [event = events_[i]](CUstream s) {
+        checkCudaErrors(cuEventRecord(event, s));
+      }));
+    }
+    for (auto &record : records) record.wait();
+    done->set_value();
+  });
+}
+
+// Later launches run on whichever CUstreams they lease, so the wait is on
+// the host rather than with cuStreamWaitEvent
+void ClientEvent::wait(ClientStream &stream) {
+  enqueue(stream, [this, recorded = recorded()] {
+    recorded.wait();
+    for (size_t i = 0; i < events_.size(); ++i) {
+      checkCudaErrors(cuCtxSetCurrent(devices_[i]));
+      checkCudaErrors(cuEventSynchronize(events_[i]));
+    }
+  });
+}
+
+bool ClientEvent::query() {
+  auto recorded = this->recorded();
+  if (recorded.wait_for(std::chrono::seconds(0)) !=
+      std::future_status::ready) {
+    return false;
+  }
+  for (size_t i = 0; i < events_.size(); ++i) {
+    checkCudaErrors(cuCtxSetCurrent(devices_[i]));
+    auto result = cuEventQuery(events_[i]);
+    if (result == CUDA_ERROR_NOT_READY) return false;
+    checkCudaErrors(result);
+  }
+  return true;
+}
+
+void ClientEvent::synchronize() {
+  recorded().wait();
+  for (size_t i = 0; i < events_.size(); ++i) {
+    checkCudaErrors(cuCtxSetCurrent(devices_[i]));
+    checkCudaErrors(cuEventSynchronize(events_[i]));
+  }
+}
+
+float ClientEvent::elapsed_since(ClientEvent &start) {
+  for (auto *event : {&start, this}) {
+    std::lock_guard<std::mutex> lock(event->mutex_);
+    if (!event->recorded_.valid()) {
+      throw std::out_of_range("event not recorded");
+    }
+  }
+  if (!start.query() || !query()) throw EventNotReady("event not ready");
+
+  float longest = 0;
+  for (size_t i = 0; i < events_.size(); ++i) {
+    checkCudaErrors(cuCtxSetCurrent(devices_[i]));
+    float milliseconds;
+    checkCudaErrors(
+        cuEventElapsedTime(&milliseconds, start.events_[i], events_[i]));
+    longest = std::max(longest, milliseconds);
+  }
+  return longest;
+}
+
+}  // namespace weft
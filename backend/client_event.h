@@ -0,0 +1,70 @@
+#ifndef WEFT_BACKEND_CLIENT_EVENT_H
+#define WEFT_BACKEND_CLIENT_EVENT_H
+
+#include <cuda.h>
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "client_stream.h"
+#include "device.h"
+
+namespace weft {
+
+// Thrown while the work before an event's latest record is still running
+class EventNotReady : public std::runtime_error {
+ public:
+  using std::runtime_error::runtime_error;
+};
+
+// Server side of a client's CUDA event: a CUevent per device, recorded on
+// every device once the work queued before the record on the ClientStream
+// has finished. Like a CUevent, one never recorded counts as complete.
+class ClientEvent {
+ public:
+  explicit ClientEvent(std::vector<Device> &devices);
+  // Waits for the records and waits still queued
+  ~ClientEvent();
+
+  ClientEvent(const ClientEvent &) = delete;
+  ClientEvent &operator=(const ClientEvent &) = delete;
+
+  // Queues a record behind the work queued on the stream so far
+  void record(ClientStream &stream);
+  // Queues a wait for the latest record, which the stream's later work
+  // follows
+  void wait(ClientStream &stream);
+
+  bool query();
+  void synchronize();
+
+  // Milliseconds from the start to the latest end over the devices, so the
+  // whole of a split launch. Device clocks cannot be compared, so this is the
+  // longest span on one device; as the start is recorded on all devices
+  // together, that is from the earliest start unless a device was still
+  // busy. Throws EventNotReady if either has not completed, and
+  // std::out_of_range if either was never recorded.
+  float elapsed_since(ClientEvent &start);
+
+ private:
+  std::vector<Device> &devices_;
+  std::vector<CUevent> events_;  // by device
+
+  std::mutex mutex_;
+  std::condition_variable unused_;
+  size_t queued_ = 0;  // records and waits
+  std::shared_future<void> recorded_;  // of the latest record, on the host
+
+  // Ready if it was never recorded
+  std::shared_future<void> recorded();
+  // Queues work using the events on the stream
+  void enqueue(ClientStream &stream, ClientStream::Work work);
+};
+
+}  // namespace weft
+
+#endif  // WEFT_BACKEND_CLIENT_EVENT_H
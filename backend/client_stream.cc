@@ -0,0 +1,57 @@
+#include "client_stream.h"
+
+#include <cuda.h>
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace weft {
+
+ClientStream::ClientStream(std::vector<Device> &devices) {
+  lanes_.reserve(devices.size());
+  for (auto &device : devices) lanes_.push_back(std::make_unique<Lane>(device));
+}
+
+ClientStream::~ClientStream() { synchronize(); }
+
+std::shared_future<void> ClientStream::dispatch(const Dependencies &after,
+                                                Work work) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++outstanding_;
+  }
+
+  // Work only waits for work taken as a dependency or queued on its stream
+  // before it, both of which follow the same order, so this never deadlocks
+  std::lock_guard<std::mutex> lock(dispatch_mutex_);
+  auto dependencies =
+      after ? after() : std::vector<std::shared_future<void>>{};
+  return worker_
+      .submit([this, dependencies = std::move(dependencies),
+               work = std::move(work)] {
+        for (const auto &dependency : dependencies) dependency.wait();
+        work();
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--outstanding_ == 0) idle_.notify_all();
+      })
+      .share();
+}
+
+void ClientStream::synchronize() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_.wait(lock, [this] { return outstanding_ == 0; });
+}
+
+std::future<void> ClientStream::submit(size_t device,
+                                       std::function<void(CUstream)> task) {
+  auto &lane = *lanes_[device];
+  return lane.worker.submit([&lane, task = std::move(task)] {
+    task(lane.device.lease_stream());
+  });
+}
+
+}  // namespace weft
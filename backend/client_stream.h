@@ -0,0 +1,68 @@
+#ifndef WEFT_BACKEND_CLIENT_STREAM_H
+#define WEFT_BACKEND_CLIENT_STREAM_H
+
+#include <cuda.h>
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "device.h"
+#include "worker.h"
+
+namespace weft {
+
+// Server side of a client's CUDA stream. Work runs in the order it was
+// queued, each once the work it depends on in other streams has finished, so
+// launches of different streams overlap and those of one stream do not. Each
+// device has a worker that runs the tasks of a split launch's slices in
+// parallel, on a CUstream leased from the device for the task.
+class ClientStream {
+ public:
+  using Work = std::function<void()>;
+  // Work in other streams that queued work must wait for
+  using Dependencies = std::function<std::vector<std::shared_future<void>>()>;
+
+  explicit ClientStream(std::vector<Device> &devices);
+  // Waits for the queued work
+  ~ClientStream();
+
+  ClientStream(const ClientStream &) = delete;
+  ClientStream &operator=(const ClientStream &) = delete;
+
+  // Work must not throw
+  void enqueue(Work work) { dispatch(nullptr, std::move(work)); }
+  // Runs the work once what `after` returns and the work queued before it
+  // have finished. `after` is called, e.g. to record the work in a Dataflow,
+  // with nothing else queued on the stream in between, so work queued later
+  // is never among it. The result is ready once the work has finished too.
+  std::shared_future<void> dispatch(const Dependencies &after, Work work);
+  void synchronize();
+
+  // Runs the task on the device's worker, on a CUstream leased until it
+  // returns. The result throws NoFreeStream if none frees up.
+  std::future<void> submit(size_t device, std::function<void(CUstream)> task);
+
+ private:
+  struct Lane {
+    Device &device;
+    Worker worker;
+
+    explicit Lane(Device &device) : device{device}, worker{device} {}
+  };
+  std::vector<std::unique_ptr<Lane>> lanes_;  // by device
+
+  std::mutex dispatch_mutex_;  // from taking the dependencies until queued
+  std::mutex mutex_;
+  std::condition_variable idle_;
+  size_t outstanding_ = 0;  // queued or running
+
+  Worker worker_;  // runs the work; last, so it stops first
+};
+
+}  // namespace weft
+
+#endif  // WEFT_BACKEND_CLIENT_STREAM_H
@@ -0,0 +1,150 @@
+#include "combine.h"
+
+#include <cuda.h>
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#include "CUDA_samples/helper_cuda_drvapi.h"
+
+namespace weft::combine {
+
+namespace {
+
+struct Sum {
+  template <typename T>
+  T operator()(T a, T b) const noexcept {
+    return a + b;
+  }
+};
+
+struct Min {
+  template <typename T>
+  T operator()(T a, T b) const noexcept {
+    return b < a ? b : a;
+  }
+};
+
+struct Max {
+  template <typename T>
+  T operator()(T a, T b) const noexcept {
+    return a < b ? b : a;
+  }
+};
+
+struct Or {
+  template <typename T>
+  T operator()(T a, T b) const noexcept {
+    return a | b;
+  }
+};
+
+}  // namespace
+
+// A plain loop over restrict pointers, which the compiler vectorizes
+template <typename T, typename F>
+static void merge(void *into, const void *partial, size_t bytes) {
+  auto *__restrict out = static_cast<T *>(into);
+  const auto *__restrict in = static_cast<const T *>(partial);
+  F f;
+  for (size_t i = 0, n = bytes / sizeof(T); i < n; ++i) {
+    out[i] = f(out[i], in[i]);
+  }
+}
+
+template <typename T>
+static Merge merger(Op op) {
+  switch (op) {
+    case FunctionMetadata::Param::SUM:
+      return merge<T, Sum>;
+    case FunctionMetadata::Param::MIN:
+      return merge<T, Min>;
+    case FunctionMetadata::Param::MAX:
+      return merge<T, Max>;
+    case FunctionMetadata::Param::OR:
+      if constexpr (std::is_integral_v<T>) return merge<T, Or>;
+      return nullptr;
+    default:
+      return nullptr;
+  }
+}
+
+Merge merger(Op op, Element element) {
+  switch (element) {
+    case FunctionMetadata::Param::INT32:
+      return merger<int32_t>(op);
+    case FunctionMetadata::Param::UINT32:
+      return merger<uint32_t>(op);
+    case FunctionMetadata::Param::FLOAT32:
+      return merger<float>(op);
+    case FunctionMetadata::Param::INT64:
+      return merger<int64_t>(op);
+    case FunctionMetadata::Param::UINT64:
+      return merger<uint64_t>(op);
+    case FunctionMetadata::Param::FLOAT64:
+      return merger<double>(op);
+    default:
+      return nullptr;
+  }
+}
+
+// Bits of the identity, as a 32- or 64-bit pattern
+template <typename T, typename Bits>
+static Bits identity(Op op) {
+  using limits = std::numeric_limits<T>;
+  T value = 0;
+  if (op == FunctionMetadata::Param::MIN) {
+    value = limits::has_infinity ? limits::infinity() : limits::max();
+  } else if (op == FunctionMetadata::Param::MAX) {
+    value = limits::has_infinity ? -limits::infinity() : limits::lowest();
+  }
+  Bits bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+static void fill32(CUdeviceptr ptr, size_t bytes, uint32_t bits,
+                   CUstream stream) {
+  checkCudaErrors(cuMemsetD32Async(ptr, bits, bytes / 4, stream));
+}
+
+// cuMemset has no 64-bit pattern, so the low and high words are each set
+// as a column of a 2D range with an 8-byte pitch
+static void fill64(CUdeviceptr ptr, size_t bytes, uint64_t bits,
+                   CUstream stream) {
+  if (bytes < 8) return;
+  checkCudaErrors(cuMemsetD2D32Async(ptr, 8, static_cast<uint32_t>(bits), 1,
+                                     bytes / 8, stream));
+  checkCudaErrors(cuMemsetD2D32Async(ptr + 4, 8,
+                                     static_cast<uint32_t>(bits >> 32), 1,
+                                     bytes / 8, stream));
+}
+
+void fill_identity(CUdeviceptr ptr, size_t bytes, Op op, Element element,
+                   CUstream stream) {
+  if (op == FunctionMetadata::Param::SUM ||
+      op == FunctionMetadata::Param::OR) {
+    checkCudaErrors(cuMemsetD8Async(ptr, 0, bytes, stream));
+    return;
+  }
+  switch (element) {
+    case FunctionMetadata::Param::INT32:
+      return fill32(ptr, bytes, identity<int32_t, uint32_t>(op), stream);
+    case FunctionMetadata::Param::UINT32:
+      return fill32(ptr, bytes, identity<uint32_t, uint32_t>(op), stream);
+    case FunctionMetadata::Param::FLOAT32:
+      return fill32(ptr, bytes, identity<float, uint32_t>(op), stream);
+    case FunctionMetadata::Param::INT64:
+      return fill64(ptr, bytes, identity<int64_t, uint64_t>(op), stream);
+    case FunctionMetadata::Param::UINT64:
+      return fill64(ptr, bytes, identity<uint64_t, uint64_t>(op), stream);
+    case FunctionMetadata::Param::FLOAT64:
+      return fill64(ptr, bytes, identity<double, uint64_t>(op), stream);
+    default:
+      return;
+  }
+}
+
+}  // namespace weft::combine
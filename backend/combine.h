@@ -0,0 +1,33 @@
+#ifndef WEFT_BACKEND_COMBINE_H
+#define WEFT_BACKEND_COMBINE_H
+
+#include <cuda.h>
+
+#include <cstddef>
+
+#include "weft.pb.h"
+
+// Reductions for kernels that accumulate into an output, e.g. a sum with
+// atomicAdd. When such a launch is split, each part accumulates into private
+// device memory starting from the identity, and the partial results are
+// merged into the Block on the host.
+namespace weft::combine {
+
+using Op = FunctionMetadata::Param::Combine;
+using Element = FunctionMetadata::Param::Element;
+
+// Merges a partial result into the data, element by element
+using Merge = void (*)(void *into, const void *partial, size_t bytes);
+
+// Null if the element type is unknown or the op does not apply to it, e.g.
+// OR on floats
+Merge merger(Op op, Element element);
+
+// Sets every element to the identity of the op, e.g. 0 for a sum or the
+// largest value for a min
+void fill_identity(CUdeviceptr ptr, size_t bytes, Op op, Element element,
+                   CUstream stream);
+
+}  // namespace weft::combine
+
+#endif  // WEFT_BACKEND_COMBINE_H
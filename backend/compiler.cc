@@ -0,0 +1,212 @@
+#include "compiler.h"
+
+#include <nvrtc.h>
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "weft.pb.h"
+
+namespace weft::compiler {
+
+static bool check(nvrtcResult result, const char *call) {
+  if (result != NVRTC_SUCCESS) {
+    std::cerr << "> NVRTC: " << call << " failed with "
+              << nvrtcGetErrorString(result) << "\n";
+  }
+  return result == NVRTC_SUCCESS;
+}
+
+static bool is_arch_option(const std::string &option) {
+  for (const char *prefix : {"-arch", "--gpu-architecture", "-code"}) {
+    if (option.rfind(prefix, 0) == 0) return true;
+  }
+  return false;
+}
+
+std::optional<std::string> compile(const Image &source,
+                                   int compute_capability) {
+  std::vector<const char *> headers, include_names;
+  for (const auto &header : source.headers()) {
+    headers.push_back(header.src().c_str());
+    include_names.push_back(header.name().c_str());
+  }
+
+  auto arch =
+      "--gpu-architecture=compute_" + std::to_string(compute_capability);
+  std::vector<const char *> options{arch.c_str()};
+  for (const auto &option : source.compile_options()) {
+    if (!is_arch_option(option)) options.push_back(option.c_str());
+  }
+
+  nvrtcProgram program;
+  if (!check(nvrtcCreateProgram(&program, source.data().c_str(),
+                                source.name().c_str(), headers.size(),
+                                headers.data(), include_names.data()),
+             "nvrtcCreateProgram")) {
+    return std::nullopt;
+  }
+
+  std::optional<std::string> ptx;
+  auto result = nvrtcCompileProgram(program, options.size(), options.data());
+  if (result != NVRTC_SUCCESS) {
+    size_t log_size;
+    nvrtcGetProgramLogSize(program, &log_size);
+    std::string log(log_size, '\0');
+    nvrtcGetProgramLog(program, log.data());
+    std::cerr << "> NVRTC: " << source.name() << " (" << arch
+              << ") failed:\n"
+              << log << "\n";
+  } else {
+    size_t size;
+    std::string data;
+    if (check(nvrtcGetPTXSize(program, &size), "nvrtcGetPTXSize")) {
+      data.resize(size);
+      if (check(nvrtcGetPTX(program, data.data()), "nvrtcGetPTX")) {
+        data.resize(size - 1);  // NUL
+        ptx = std::move(data);
+      }
+    }
+  }
+  nvrtcDestroyProgram(&program);
+  return ptx;
+}
+
+static std::string trim(std::string_view str) {
+  auto begin = str.find_first_not_of(" \t\r\n");
+  if (begin == std::string_view::npos) return {};
+  auto end = str.find_last_not_of(" \t\r\n");
+  return std::string(str.substr(begin, end - begin + 1));
+}
+
+// Position just past the bracket matching the one at `open`
+static size_t skip_balanced(const std::string &src, size_t open) {
+  int depth = 0;
+  for (size_t i = open; i < src.size(); ++i) {
+    if (src[i] == '(' || src[i] == '{' || src[i] == '[') ++depth;
+    if (src[i] == ')' || src[i] == '}' || src[i] == ']') {
+      if (--depth == 0) return i + 1;
+    }
+  }
+  return std::string::npos;
+}
+
+// C++ expression of the given arithmetic type with the argument's bytes
+static std::optional<std::string> literal(std::string type,
+                                          const std::string &bytes) {
+  // Normalize "const unsigned  int" to "unsigned int"
+  type = std::regex_replace(type, std::regex("\\b(const|volatile)\\b"), "");
+  type = trim(std::regex_replace(type, std::regex("\\s+"), " "));
+
+  uint64_t bits = 0;
+  if (bytes.size() > sizeof(bits)) return std::nullopt;
+  std::memcpy(&bits, bytes.data(), bytes.size());
+
+  char value[64];
+  if (type == "float" && bytes.size() == 4) {
+    std::snprintf(value, sizeof(value), "__int_as_float(0x%08llx)",
+                  static_cast<unsigned long long>(bits));
+  } else if (type == "double" && bytes.size() == 8) {
+    std::snprintf(value, sizeof(value), "__longlong_as_double(0x%016llxll)",
+                  static_cast<unsigned long long>(bits));
+  } else if (type == "bool") {
+    return bits ? "true" : "false";
+  } else if (std::regex_match(
+                 type, std::regex("(unsigned|signed)?( ?(char|short|int|long|"
+                                  "long long))?|u?int(8|16|32|64)_t|size_t"))) {
+    bool is_signed = type.find("unsigned") == std::string::npos &&
+                     type.rfind("uint", 0) != 0 && type != "size_t";
+    if (is_signed) {
+      // Sign-extend from the argument's width
+      auto shift = 64 - 8 * bytes.size();
+      auto signed_bits = static_cast<int64_t>(bits << shift) >> shift;
+      std::snprintf(value, sizeof(value), "(%lldll)",
+                    static_cast<long long>(signed_bits));
+    } else {
+      std::snprintf(value, sizeof(value), "%lluull",
+                    static_cast<unsigned long long>(bits));
+    }
+  } else {
+    return std::nullopt;
+  }
+  return "static_cast<" + type + ">(" + value + ")";
+}
+
+std::optional<std::string> specialize(
+    const std::string &src, const std::string &kernel,
+    const std::vector<std::optional<std::string>> &constants) {
+  // Find the __global__ definition (not a declaration) of the kernel
+  std::regex name_regex("\\b" + kernel + "\\s*\\(");
+  for (auto it = std::sregex_iterator(src.begin(), src.end(), name_regex);
+       it != std::sregex_iterator(); ++it) {
+    auto open = static_cast<size_t>(it->position() + it->length() - 1);
+    auto decl_begin = src.find_last_of(";}", it->position());
+    decl_begin = decl_begin == std::string::npos ? 0 : decl_begin + 1;
+    if (src.substr(decl_begin, it->position() - decl_begin)
+            .find("__global__") == std::string::npos) {
+      continue;
+    }
+
+    auto close = skip_balanced(src, open);
+    if (close == std::string::npos) return std::nullopt;
+    auto body = src.find_first_not_of(" \t\r\n", close);
+    if (body == std::string::npos || src[body] != '{') continue;
+
+    // Split the parameter list on top-level commas
+    std::vector<std::pair<size_t, size_t>> params;  // [begin, end) in src
+    int depth = 0;
+    size_t begin = open + 1;
+    for (size_t i = open + 1; i < close - 1; ++i) {
+      if (std::strchr("([{<", src[i])) ++depth;
+      if (std::strchr(")]}>", src[i])) --depth;
+      if (src[i] == ',' && depth == 0) {
+        params.emplace_back(begin, i);
+        begin = i + 1;
+      }
+    }
+    params.emplace_back(begin, close - 1);
+
+    std::string result = src.substr(0, open + 1);
+    std::string locals;
+    size_t index = 0;  // into constants, skipping _weft parameters
+    for (const auto &[param_begin, param_end] : params) {
+      auto decl = trim(std::string_view(src).substr(
+          param_begin, param_end - param_begin));
+      std::smatch match;
+      if (!std::regex_match(decl, match,
+                            std::regex("(.*[^A-Za-z0-9_])([A-Za-z_]\\w*)"))) {
+        return std::nullopt;
+      }
+      auto type = trim(match[1].str());
+      auto name = match[2].str();
+
+      if (!result.empty() && result.back() != '(') result += ", ";
+      if (name.rfind("_weft", 0) == 0 || index >= constants.size() ||
+          !constants[index]) {
+        result += decl;
+      } else {
+        auto value = literal(type, *constants[index]);
+        if (!value) return std::nullopt;
+        result += type + " _weft_const_" + name;
+        locals += "\n  " + type + " " + name + " = " + *value + ";";
+      }
+      if (name.rfind("_weft", 0) != 0) ++index;
+    }
+
+    result += src.substr(close - 1, body + 1 - (close - 1));
+    result += locals;
+    result += src.substr(body + 1);
+    return result;
+  }
+  return std::nullopt;
+}
+
+}  // namespace weft::compiler
@@ -0,0 +1,30 @@
+#ifndef WEFT_BACKEND_COMPILER_H
+#define WEFT_BACKEND_COMPILER_H
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "weft.pb.h"
+
+namespace weft::compiler {
+
+// Compiles a CUDA source image with NVRTC to PTX for one exact architecture,
+// left for the driver to finish so the PTX can be rewritten first. Any
+// architecture options of the client are replaced.
+std::optional<std::string> compile(const Image &source,
+                                   int compute_capability);
+
+// Rewrites the definition of `kernel` so that each parameter with a constant
+// becomes a local initialized with that value, letting NVRTC fold it. The
+// parameter list (and so the argument layout) is unchanged. Constants are
+// indexed like the client's metadata, i.e. skipping _weft parameters, and hold
+// the raw argument bytes. Only arithmetic parameter types are specialized;
+// returns nullopt if the kernel or a type cannot be handled.
+std::optional<std::string> specialize(
+    const std::string &src, const std::string &kernel,
+    const std::vector<std::optional<std::string>> &constants);
+
+}  // namespace weft::compiler
+
+#endif  // WEFT_BACKEND_COMPILER_H
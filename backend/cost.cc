@@ -0,0 +1,131 @@
+#include "cost.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "kernel.h"
+#include "weft/hash.h"
+
+namespace weft::cost {
+
+namespace {
+
+// Kernel time against blocks, with older slices fading out so the fit
+// follows changes in load
+struct Fit {
+  double n = 0, x = 0, y = 0, xx = 0, xy = 0;
+
+  void add(double blocks, double ms) {
+    constexpr double decay = 0.95;
+    n = n * decay + 1;
+    x = x * decay + blocks;
+    y = y * decay + ms;
+    xx = xx * decay + blocks * blocks;
+    xy = xy * decay + blocks * ms;
+  }
+
+  // Milliseconds for a number of blocks. Slices of one size cannot separate
+  // the fixed part, so then the time is taken as proportional.
+  double predict(double blocks) const {
+    double spread = n * xx - x * x;
+    if (spread <= 1e-9 * n * xx) return x > 0 ? blocks * y / x : y / n;
+    double slope = std::max(0.0, (n * xy - x * y) / spread);
+    double intercept = std::max(0.0, (y - slope * x) / n);
+    return intercept + slope * blocks;
+  }
+};
+
+// Exponential moving average, with a default until the first sample
+struct Average {
+  double value;
+  bool sampled = false;
+
+  void add(double sample) {
+    constexpr double weight = 0.1;
+    value = sampled ? value + weight * (sample - value) : sample;
+    sampled = true;
+  }
+};
+
+}  // namespace
+
+static std::mutex cost_mutex;
+static std::unordered_map<uint64_t, Fit> fits;  // by kernel and block shape
+static Average upload_bytes_per_ms{1e7};        // 10 GB/s until measured
+static Average write_back_bytes_per_ms{1e7};
+static Average overhead_ms{0.05};  // of a slice, beyond its copies and kernel
+
+static uint64_t key(const kernel::Function &func,
+                    const kernel::ExecutionArgs &execution) {
+  auto hash = fnv1a(func.name(), fnv1a(func.module().hash()));
+  for (auto value : {execution.blockDimX, execution.blockDimY,
+                     execution.blockDimZ, execution.sharedMemBytes}) {
+    hash = fnv1a_value(value, hash);
+  }
+  return hash;
+}
+
+void record(const kernel::Function &func, const kernel::ExecutionArgs &slice,
+            const kernel::Timing &timing) {
+  double blocks = double(slice.gridDimX) * slice.gridDimY * slice.gridDimZ;
+  std::lock_guard<std::mutex> lock(cost_mutex);
+  fits[key(func, slice)].add(blocks, timing.kernel_ms);
+  if (timing.upload_bytes && timing.upload_ms > 0) {
+    upload_bytes_per_ms.add(timing.upload_bytes / timing.upload_ms);
+  }
+  if (timing.write_back_bytes && timing.write_back_ms > 0) {
+    write_back_bytes_per_ms.add(timing.write_back_bytes /
+                                timing.write_back_ms);
+  }
+  overhead_ms.add(std::max(0.0f, timing.total_ms - timing.upload_ms -
+                                     timing.kernel_ms - timing.write_back_ms));
+}
+
+std::optional<size_t> devices(const kernel::Function &func,
+                              const kernel::ExecutionArgs &execution,
+                              const std::vector<Transfers> &devices,
+                              size_t written_bytes) {
+  double blocks =
+      double(execution.gridDimX) * execution.gridDimY * execution.gridDimZ;
+
+  std::vector<double> predicted;
+  {
+    std::lock_guard<std::mutex> lock(cost_mutex);
+    auto it = fits.find(key(func, execution));
+    if (it == fits.end()) return std::nullopt;
+
+    // The slowest device decides
+    double weights = 0;
+    for (size_t count = 1; count <= devices.size(); ++count) {
+      weights += devices[count - 1].weight;
+      double slowest = 0;
+      for (size_t i = 0; i < count; ++i) {
+        double share = weights > 0 ? devices[i].weight / weights : 1.0 / count;
+        slowest = std::max(
+            slowest,
+            overhead_ms.value +
+                devices[i].upload_bytes / upload_bytes_per_ms.value +
+                it->second.predict(blocks * share) +
+                written_bytes / write_back_bytes_per_ms.value);
+      }
+      predicted.push_back(slowest);
+    }
+  }
+
+  auto best = std::min_element(predicted.begin(), predicted.end()) -
+              predicted.begin() + 1;
+  std::clog << "> Cost: " << func.name() << " on " << best
+            << " device(s), predicted";
+  for (size_t i = 0; i < predicted.size(); ++i) {
+    std::clog << (i ? ", " : " ") << predicted[i] << " ms on " << i + 1;
+  }
+  std::clog << "\n";
+  return best;
+}
+
+}  // namespace weft::cost
@@ -0,0 +1,36 @@
+#ifndef WEFT_BACKEND_COST_H
+#define WEFT_BACKEND_COST_H
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+#include "kernel.h"
+
+// Online model of what a launch costs on how many devices. Each kernel and
+// block shape gets a least-squares fit of kernel time against the blocks a
+// slice runs, refreshed by every slice; transfer rates and the fixed cost of
+// a slice are shared by all kernels.
+namespace weft::cost {
+
+// Adds what one slice of a launch took
+void record(const kernel::Function &func, const kernel::ExecutionArgs &slice,
+            const kernel::Timing &timing);
+
+// What running a launch on a device would move
+struct Transfers {
+  double weight;  // share of the grid, relative to the other devices
+  size_t upload_bytes;
+};
+
+// How many of the devices, in order, minimize the predicted time of the
+// launch. Each device writes back written_bytes. Nullopt until the kernel
+// has run with this block shape. The decision is logged.
+std::optional<size_t> devices(const kernel::Function &func,
+                              const kernel::ExecutionArgs &execution,
+                              const std::vector<Transfers> &devices,
+                              size_t written_bytes);
+
+}  // namespace weft::cost
+
+#endif  // WEFT_BACKEND_COST_H
@@ -0,0 +1,67 @@
+#include "dataflow.h"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace weft {
+
+static bool finished(const std::shared_future<void> &work) {
+  return work.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+void Dataflow::collect(const Access &access,
+                       std::vector<std::shared_future<void>> &after) {
+  auto follow = [&](const std::shared_future<void> &work) {
+    if (work.valid() && !finished(work)) after.push_back(work);
+  };
+
+  for (auto block : access.reads) {
+    auto it = blocks_.find(block);
+    if (it != blocks_.end()) follow(it->second.writer);
+  }
+  for (auto block : access.writes) {
+    auto it = blocks_.find(block);
+    if (it == blocks_.end()) continue;
+    follow(it->second.writer);
+    for (const auto &reader : it->second.readers) follow(reader);
+  }
+}
+
+std::vector<std::shared_future<void>> Dataflow::add(
+    const Access &access, std::shared_future<void> done) {
+  std::vector<std::shared_future<void>> after;
+  std::lock_guard<std::mutex> lock(mutex_);
+  collect(access, after);
+
+  for (auto block : access.reads) {
+    auto &readers = blocks_[block].readers;
+    readers.erase(std::remove_if(readers.begin(), readers.end(), finished),
+                  readers.end());
+    readers.push_back(done);
+  }
+  for (auto block : access.writes) {
+    auto &accesses = blocks_[block];
+    accesses.writer = done;
+    accesses.readers.clear();
+  }
+  return after;
+}
+
+std::vector<std::shared_future<void>> Dataflow::hazards(
+    const Access &access) {
+  std::vector<std::shared_future<void>> after;
+  std::lock_guard<std::mutex> lock(mutex_);
+  collect(access, after);
+  return after;
+}
+
+void Dataflow::erase(uint64_t block) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  blocks_.erase(block);
+}
+
+}  // namespace weft
@@ -0,0 +1,48 @@
+#ifndef WEFT_BACKEND_DATAFLOW_H
+#define WEFT_BACKEND_DATAFLOW_H
+
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace weft {
+
+// Orders work by the Blocks it reads and writes instead of by arrival. Work
+// follows the last writer of each Block it uses and, for the Blocks it
+// writes, the readers since; work touching other Blocks may run concurrently.
+class Dataflow {
+ public:
+  struct Access {
+    std::vector<uint64_t> reads;  // Block handles
+    std::vector<uint64_t> writes;
+  };
+
+  // Records work that finishes with `done` as the latest access to its
+  // Blocks, and returns the work it must wait for
+  std::vector<std::shared_future<void>> add(const Access &access,
+                                            std::shared_future<void> done);
+
+  // Work the access must wait for, without recording it
+  std::vector<std::shared_future<void>> hazards(const Access &access);
+
+  // Forgets a freed Block
+  void erase(uint64_t block);
+
+ private:
+  struct Accesses {
+    std::shared_future<void> writer;
+    std::vector<std::shared_future<void>> readers;  // since the writer
+  };
+
+  std::mutex mutex_;
+  std::unordered_map<uint64_t, Accesses> blocks_;
+
+  // Called with mutex_ held
+  void collect(const Access &access,
+               std::vector<std::shared_future<void>> &after);
+};
+
+}  // namespace weft
+
+#endif  // WEFT_BACKEND_DATAFLOW_H
@@ -0,0 +1,75 @@
+#include "detector.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "weft/hash.h"
+
+namespace weft::graph {
+
+uint64_t signature(const Launch& launch) {
+  const auto& request = *launch.request;
+  auto hash = fnv1a_value(request.f());
+  hash = fnv1a_value(request.hstream(), hash);
+  for (auto value : {request.griddimx(), request.griddimy(),
+                     request.griddimz(), request.blockdimx(),
+                     request.blockdimy(), request.blockdimz(),
+                     request.sharedmembytes()}) {
+    hash = fnv1a_value(value, hash);
+  }
+  return hash;
+}
+
+Detector::Verdict Detector::observe(Launch launch) {
+  auto launched = signature(launch);
+  Verdict verdict;
+  if (!sequence_.empty()) {
+    if (launched == sequence_[position_]) {
+      held_.push_back(std::move(launch));
+      if (++position_ == sequence_.size()) {
+        position_ = 0;
+        // A single launch gains nothing from a graph
+        (held_.size() > 1 ? verdict.batch : verdict.flush) = std::move(held_);
+        held_.clear();
+      }
+      return verdict;
+    }
+
+    std::clog << "> Graph: sequence of " << sequence_.size()
+              << " launches diverged, " << held_.size()
+              << " held back run as usual\n";
+    verdict.flush = std::move(held_);
+    held_.clear();
+    sequence_.clear();
+    history_.clear();
+    position_ = 0;
+  }
+  verdict.flush.push_back(std::move(launch));
+
+  history_.push_back(launched);
+  if (history_.size() > max_length * repeats) history_.erase(history_.begin());
+  auto n = history_.size();
+  for (size_t length = 2; length <= max_length && length * repeats <= n;
+       ++length) {
+    bool periodic = true;
+    for (size_t i = n - length * (repeats - 1); i < n && periodic; ++i) {
+      periodic = history_[i] == history_[i - length];
+    }
+    if (periodic) {
+      sequence_.assign(history_.end() - length, history_.end());
+      break;
+    }
+  }
+  return verdict;
+}
+
+std::vector<Launch> Detector::release() {
+  auto released = std::move(held_);
+  held_.clear();
+  return released;
+}
+
+}  // namespace weft::graph
@@ -0,0 +1,61 @@
+#ifndef WEFT_BACKEND_DETECTOR_H
+#define WEFT_BACKEND_DETECTOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "weft.pb.h"
+
+namespace weft::kernel {
+class Function;
+}  // namespace weft::kernel
+
+// Finding the launch sequences a client repeats, to replay as graphs, see
+// graph.h
+namespace weft::graph {
+
+struct Launch {
+  const kernel::Function *func;
+  std::shared_ptr<const KernelLaunch> request;
+};
+
+// Of a launch's kernel, stream and geometry
+uint64_t signature(const Launch &launch);
+
+// Finds the sequence a client repeats, by kernel, stream and geometry, and
+// holds back its later iterations
+class Detector {
+ public:
+  struct Verdict {
+    std::vector<Launch> flush;  // to run one by one, in order
+    std::vector<Launch> batch;  // a whole iteration, to run as a graph
+  };
+
+  // The launch is held back, completes a batch (of what is held since the
+  // last release), or diverges from the sequence, flushing what was held
+  // with it
+  Verdict observe(Launch launch);
+
+  // Launches held back, e.g. before the client waits for its results. The
+  // sequence stays, so the rest of the iteration is held again.
+  std::vector<Launch> release();
+
+  // Launches in the sequence, 0 while none is known
+  size_t length() const noexcept { return sequence_.size(); }
+
+ private:
+  // Iterations of a sequence seen in a row before it is held back
+  static constexpr size_t repeats = 3;
+  static constexpr size_t max_length = 64;
+
+  std::vector<uint64_t> history_;  // signatures of recent launches
+  std::vector<uint64_t> sequence_;
+  size_t position_ = 0;  // in the sequence of the next launch
+  std::vector<Launch> held_;
+};
+
+}  // namespace weft::graph
+
+#endif  // WEFT_BACKEND_DETECTOR_H
@@ -2,7 +2,13 @@
 
 #include <cuda.h>
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
 
 #include "CUDA_samples/helper_cuda_drvapi.h"
 #include "weft.grpc.pb.h"
@@ -11,6 +17,8 @@ using google::protobuf::RepeatedPtrField;
 using weft::FunctionMetadata_Param;
 namespace weft {
 
+// The hardware limit on resident grids is not a device attribute, so this
+// comes from the architecture, defaulting to that of current ones
 inline int get_max_concurrency_from_version(int major, int minor) {
   // Refer to ConvertSMVer2Cores
   typedef struct {
@@ -33,6 +41,7 @@ inline int get_max_concurrency_from_version(int major, int minor) {
 
     index++;
   }
+  return 128;
 }
 
 Device::Device(int device_idx) : device_idx_{device_idx} {
@@ -47,24 +56,126 @@ Device::Device(int device_idx) : device_idx_{device_idx} {
       &compute_capability_minor_, CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MINOR,
       device_));
 
-  max_concurrent_kernels_ = get_max_concurrency_from_version(
-      compute_capability_major_, compute_capability_minor_);
+  checkCudaErrors(cuDeviceGetAttribute(
+      &multiprocessor_count_, CU_DEVICE_ATTRIBUTE_MULTIPROCESSOR_COUNT,
+      device_));
+  checkCudaErrors(cuDeviceGetAttribute(
+      &clock_rate_, CU_DEVICE_ATTRIBUTE_CLOCK_RATE, device_));
+
+  int concurrent_kernels;
+  checkCudaErrors(cuDeviceGetAttribute(
+      &concurrent_kernels, CU_DEVICE_ATTRIBUTE_CONCURRENT_KERNELS, device_));
+  max_concurrent_kernels_ =
+      concurrent_kernels ? get_max_concurrency_from_version(
+                               compute_capability_major_,
+                               compute_capability_minor_)
+                         : 1;
 
   std::clog << "Device " << device_idx_ << ": \"" << device_name_
             << "\" (Compute " << compute_capability_major_ << "."
             << compute_capability_minor_ << " — "
-            << "Max Kernel Concurrency: " << max_concurrent_kernels_ << ")\n";
+            << "Max Kernel Concurrency: " << max_concurrent_kernels_ << ", "
+            << multiprocessor_count_ << " SMs at " << clock_rate_ / 1000
+            << " MHz)\n";
 
   checkCudaErrors(cuDevicePrimaryCtxRetain(&context_, device_));
   checkCudaErrors(cuCtxSetCurrent(context_));
 
-  for (int i = 0; i < max_concurrent_kernels_; i++) {
+  for (int i = 0; i < std::min<int>(max_concurrent_kernels_, max_streams);
+       i++) {
     CUstream stream;
     checkCudaErrors(cuStreamCreate(&stream, CU_STREAM_NON_BLOCKING));
-    stream_pool.bounded_push(std::move(stream));
+    stream_pool_.bounded_push(stream);
   }
 }
 
 Device::~Device() { checkCudaErrors(cuDevicePrimaryCtxRelease(device_)); }
 
+size_t Device::free_memory() const {
+  checkCudaErrors(cuCtxSetCurrent(context_));
+  size_t free, total;
+  checkCudaErrors(cuMemGetInfo(&free, &total));
+  return free;
+}
+
+StreamLease Device::lease_stream() {
+  // Beyond this the devices are stuck rather than busy
+  constexpr auto max_wait = std::chrono::seconds(30);
+
+  CUstream stream;
+  if (stream_pool_.pop(stream)) return StreamLease(*this, stream);
+
+  auto start = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> lock(stream_mutex_);
+  if (!stream_released_.wait_for(lock, max_wait,
+                                 [&] { return stream_pool_.pop(stream); })) {
+    throw NoFreeStream("no stream freed up on Device " +
+                       std::to_string(device_idx_));
+  }
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::clog << "> Device: " << device_idx_ << " waited " << elapsed.count()
+            << " ms for a free stream\n";
+  return StreamLease(*this, stream);
+}
+
+std::optional<StreamLease> Device::try_lease_stream() {
+  CUstream stream;
+  if (!stream_pool_.pop(stream)) return std::nullopt;
+  return StreamLease(*this, stream);
+}
+
+EventLease Device::lease_event() {
+  {
+    std::lock_guard<std::mutex> lock(event_mutex_);
+    if (!event_pool_.empty()) {
+      auto event = event_pool_.back();
+      event_pool_.pop_back();
+      return EventLease(*this, event);
+    }
+  }
+  CUevent event;
+  checkCudaErrors(cuCtxSetCurrent(context_));
+  checkCudaErrors(cuEventCreate(&event, CU_EVENT_DEFAULT));
+  return EventLease(*this, event);
+}
+
+void Device::release_event(CUevent event) {
+  std::lock_guard<std::mutex> lock(event_mutex_);
+  event_pool_.push_back(event);
+}
+
+void Device::release_stream(CUstream stream) {
+  stream_pool_.bounded_push(stream);
+  std::lock_guard<std::mutex> lock(stream_mutex_);
+  stream_released_.notify_one();
+}
+
+EventLease::~EventLease() {
+  if (device_) device_->release_event(event_);
+}
+
+StreamLease::~StreamLease() {
+  if (!device_) return;
+
+  // Host functions may not call into CUDA, but can return the stream
+  struct Release {
+    Device *device;
+    CUstream stream;
+  };
+  auto release = new Release{device_, stream_};
+  auto result = cuLaunchHostFunc(
+      stream_,
+      [](void *data) {
+        auto release = static_cast<Release *>(data);
+        release->device->release_stream(release->stream);
+        delete release;
+      },
+      release);
+  if (result != CUDA_SUCCESS) {
+    delete release;
+    device_->release_stream(stream_);
+  }
+}
+
 }  // namespace weft
@@ -5,11 +5,70 @@
 
 #include <boost/lockfree/policies.hpp>
 #include <boost/lockfree/queue.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace weft {
 
-// Forward declarations
+class Device;
+
+// Thrown when no stream of a device frees up in time, see lease_stream
+class NoFreeStream : public std::runtime_error {
+ public:
+  using std::runtime_error::runtime_error;
+};
+
+// A stream taken from a Device's pool. Once released, it goes back to the
+// pool when the work queued on it so far completes, without blocking.
+class StreamLease {
+ public:
+  StreamLease(Device &device, CUstream stream)
+      : device_{&device}, stream_{stream} {}
+  ~StreamLease();
+
+  StreamLease(const StreamLease &) = delete;
+  StreamLease &operator=(const StreamLease &) = delete;
+
+  StreamLease(StreamLease &&other) noexcept
+      : device_{other.device_}, stream_{other.stream_} {
+    other.device_ = nullptr;
+  }
+
+  operator CUstream() const noexcept { return stream_; }
+
+ private:
+  Device *device_;
+  CUstream stream_;
+};
+
+// An event taken from a Device's pool, with timing. Once released, it goes
+// back to the pool at once: elapsed times must have been read by then, while
+// stream waits already queued on it are unaffected by its next record.
+class EventLease {
+ public:
+  EventLease(Device &device, CUevent event)
+      : device_{&device}, event_{event} {}
+  ~EventLease();
+
+  EventLease(const EventLease &) = delete;
+  EventLease &operator=(const EventLease &) = delete;
+
+  EventLease(EventLease &&other) noexcept
+      : device_{other.device_}, event_{other.event_} {
+    other.device_ = nullptr;
+  }
+
+  operator CUevent() const noexcept { return event_; }
+
+ private:
+  Device *device_;
+  CUevent event_;
+};
+
 class Device {
  public:
   explicit Device(int device_idx);
@@ -23,7 +82,24 @@ class Device {
 
   operator CUdevice() const { return device_; }
   operator CUcontext() const { return context_; }
-  boost::lockfree::queue<CUstream, boost::lockfree::capacity<128>> stream_pool;
+  int compute_capability() const noexcept {
+    return compute_capability_major_ * 10 + compute_capability_minor_;
+  }
+  int multiprocessor_count() const noexcept { return multiprocessor_count_; }
+  // Relative speed for sharing out a grid: SMs times their clock
+  double throughput() const noexcept {
+    return static_cast<double>(multiprocessor_count_) * clock_rate_;
+  }
+  // Bytes of device memory not in use, binding the context on this thread
+  size_t free_memory() const;
+  // Waits (for a bounded time) for a stream whose earlier work completed.
+  // Throws NoFreeStream if none frees up.
+  StreamLease lease_stream();
+  // A stream only if one is free now, for work that can do without
+  std::optional<StreamLease> try_lease_stream();
+  // Reuses a pooled event, creating one (and binding the context on this
+  // thread) if none is free
+  EventLease lease_event();
 
   friend std::ostream &operator<<(std::ostream &os, const Device &device) {
     os << device.device_idx_;
@@ -40,6 +116,23 @@ class Device {
   int compute_capability_major_;
   int compute_capability_minor_;
   int max_concurrent_kernels_;
+  int multiprocessor_count_;
+  int clock_rate_;  // kHz
+
+  friend class StreamLease;
+  static constexpr size_t max_streams = 128;
+  boost::lockfree::queue<CUstream, boost::lockfree::capacity<max_streams>>
+      stream_pool_;
+  std::mutex stream_mutex_;
+  std::condition_variable stream_released_;
+
+  void release_stream(CUstream stream);
+
+  friend class EventLease;
+  std::mutex event_mutex_;
+  std::vector<CUevent> event_pool_;
+
+  void release_event(CUevent event);
 };
 
 }  // namespace weft
@@ -0,0 +1,72 @@
+#include "fatbin.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+
+namespace weft::fatbin {
+
+// Layout as emitted by nvcc/fatbinary (undocumented, see cuobjdump)
+constexpr uint32_t fatbin_magic = 0xba55ed50;
+constexpr uint16_t kind_ptx = 1;
+constexpr uint16_t kind_elf = 2;
+constexpr uint64_t flag_compressed = 0x2000;
+
+struct Header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t header_size;
+  uint64_t fat_size;
+};
+
+struct EntryHeader {
+  uint16_t kind;
+  uint16_t unknown0;
+  uint32_t header_size;
+  uint64_t size;
+  uint32_t compressed_size;
+  uint32_t unknown1;
+  uint16_t minor;
+  uint16_t major;
+  uint32_t arch;
+  uint32_t obj_name_offset;
+  uint32_t obj_name_len;
+  uint64_t flags;
+  uint64_t zero;
+  uint64_t decompressed_size;
+};
+
+std::optional<Entry> select(std::string_view fatbin, int compute_capability) {
+  Header header;
+  if (fatbin.size() < sizeof(header)) return std::nullopt;
+  std::memcpy(&header, fatbin.data(), sizeof(header));
+  if (header.magic != fatbin_magic) return std::nullopt;
+
+  auto end = std::min<uint64_t>(fatbin.size(),
+                                uint64_t{header.header_size} + header.fat_size);
+  std::optional<Entry> best_sass, best_ptx;
+  for (uint64_t pos = header.header_size; pos + sizeof(EntryHeader) <= end;) {
+    EntryHeader entry;
+    std::memcpy(&entry, fatbin.data() + pos, sizeof(entry));
+    auto payload = pos + entry.header_size;
+    if (entry.header_size < sizeof(entry) || payload + entry.size > end) break;
+    pos = payload + entry.size;
+
+    int arch = static_cast<int>(entry.arch);
+    if ((entry.flags & flag_compressed) || arch > compute_capability) continue;
+    Entry candidate{entry.kind == kind_ptx, arch,
+                    fatbin.substr(payload, entry.size)};
+
+    if (entry.kind == kind_elf && arch / 10 == compute_capability / 10) {
+      if (arch == compute_capability) return candidate;
+      if (!best_sass || arch > best_sass->arch) best_sass = candidate;
+    } else if (entry.kind == kind_ptx) {
+      if (!best_ptx || arch > best_ptx->arch) best_ptx = candidate;
+    }
+  }
+  return best_sass ? best_sass : best_ptx;
+}
+
+}  // namespace weft::fatbin
@@ -0,0 +1,23 @@
+#ifndef WEFT_BACKEND_FATBIN_H
+#define WEFT_BACKEND_FATBIN_H
+
+#include <optional>
+#include <string_view>
+
+namespace weft::fatbin {
+
+struct Entry {
+  bool is_ptx;
+  int arch;  // e.g. 86 for sm_86/compute_86
+  std::string_view data;
+};
+
+// Best entry of a fatbin for a device: SASS for the exact architecture, else
+// SASS from an older minor of the same major, else the newest PTX that is not
+// newer than the device. Compressed entries are skipped, so no entry may be
+// found even though the driver could still load the fatbin itself.
+std::optional<Entry> select(std::string_view fatbin, int compute_capability);
+
+}  // namespace weft::fatbin
+
+#endif  // WEFT_BACKEND_FATBIN_H
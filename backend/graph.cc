@@ -0,0 +1,144 @@
+#include "graph.h"
+
+#include <cuda.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "CUDA_samples/helper_cuda_drvapi.h"
+#include "kernel.h"
+#include "memory.h"
+
+namespace weft::graph {
+
+bool enabled() {
+  static const bool enabled = [] {
+    const char* value = std::getenv("WEFT_GRAPH");
+    bool enabled = value && *value && std::strcmp(value, "0") != 0;
+    if (enabled) std::clog << "> Graph: repeated launches replay as graphs\n";
+    return enabled;
+  }();
+  return enabled;
+}
+
+void Graphs::Graph::reset() {
+  if (!graph) return;
+  checkCudaErrors(cuCtxSetCurrent(context));
+  if (exec) checkCudaErrors(cuGraphExecDestroy(exec));
+  checkCudaErrors(cuGraphDestroy(graph));
+  exec = nullptr;
+  graph = nullptr;
+  signatures.clear();
+  nodes.clear();
+  functions.clear();
+}
+
+Graphs::~Graphs() {
+  for (auto& graph : graphs_) graph.second->reset();
+}
+
+void Graphs::run(Device& device, const std::vector<Launch>& batch,
+                 CUstream stream) {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<uint64_t> signatures;
+  for (const auto& launch : batch) signatures.push_back(signature(launch));
+  Graph* graph;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& slot = graphs_[static_cast<CUdevice>(device)];
+    if (!slot) {
+      slot = std::make_unique<Graph>();
+      slot->context = static_cast<CUcontext>(device);
+    }
+    graph = slot.get();
+  }
+  std::unique_lock<std::mutex> lock(graph->mutex);
+
+  // Adds the launches to the empty graph, or sets its nodes to them. False
+  // if a node runs another kernel than its launch now would, e.g. once a
+  // specialized build of it is ready.
+  std::vector<memory::Block*> written;
+  auto bind = [&](bool build) {
+    written.clear();
+    for (size_t i = 0; i < batch.size(); ++i) {
+      kernel::ExecutionArgs execution{*batch[i].request};
+      bool matches = true;
+      auto blocks = batch[i].func->bind(
+          device, execution, stream, [&](CUfunction function, void** params) {
+            CUDA_KERNEL_NODE_PARAMS node{};
+            node.func = function;
+            node.gridDimX = execution.gridDimX;
+            node.gridDimY = execution.gridDimY;
+            node.gridDimZ = execution.gridDimZ;
+            node.blockDimX = execution.blockDimX;
+            node.blockDimY = execution.blockDimY;
+            node.blockDimZ = execution.blockDimZ;
+            node.sharedMemBytes = execution.sharedMemBytes;
+            node.kernelParams = params;
+            if (build) {
+              CUgraphNode added;
+              auto* previous =
+                  graph->nodes.empty() ? nullptr : &graph->nodes.back();
+              checkCudaErrors(cuGraphAddKernelNode(
+                  &added, graph->graph, previous, previous ? 1 : 0, &node));
+              graph->nodes.push_back(added);
+              graph->functions.push_back(function);
+            } else if (graph->functions[i] != function) {
+              matches = false;
+            } else {
+              checkCudaErrors(cuGraphExecKernelNodeSetParams(
+                  graph->exec, graph->nodes[i], &node));
+            }
+          });
+      if (!matches) return false;
+      written.insert(written.end(), blocks.begin(), blocks.end());
+    }
+    return true;
+  };
+
+  // Built afresh for another sequence, a changed kernel, or after a build
+  // that failed part-way
+  bool built = false;
+  if (!graph->exec || graph->signatures != signatures || !bind(false)) {
+    graph->reset();
+    try {
+      checkCudaErrors(cuGraphCreate(&graph->graph, 0));
+      bind(true);
+      checkCudaErrors(
+          cuGraphInstantiateWithFlags(&graph->exec, graph->graph, 0));
+    } catch (...) {
+      graph->reset();
+      throw;
+    }
+    graph->signatures = std::move(signatures);
+    built = true;
+  }
+  checkCudaErrors(cuGraphLaunch(graph->exec, stream));
+  lock.unlock();
+
+  checkCudaErrors(cuStreamSynchronize(stream));
+  std::sort(written.begin(), written.end());
+  written.erase(std::unique(written.begin(), written.end()), written.end());
+  for (auto* block : written) block->write_back(device, stream);
+
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::clog << "> Graph: " << (built ? "built" : "replayed") << " "
+            << batch.size() << " launches (";
+  for (size_t i = 0; i < batch.size(); ++i) {
+    std::clog << (i ? ", " : "") << batch[i].func->name();
+  }
+  std::clog << ") on Device: " << device << " in " << elapsed.count()
+            << " ms\n";
+}
+
+}  // namespace weft::graph
@@ -0,0 +1,59 @@
+#ifndef WEFT_BACKEND_GRAPH_H
+#define WEFT_BACKEND_GRAPH_H
+
+#include <cuda.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "detector.h"
+#include "device.h"
+
+// Opt-in replay of launch sequences that a client repeats, e.g. every
+// iteration of a training loop, as CUDA graphs. Once a sequence has come
+// round a few times, later iterations are held back until complete and run
+// as one graph on one device, with a single upload, synchronization and
+// write back. Enabled by WEFT_GRAPH=1.
+namespace weft::graph {
+
+bool enabled();
+
+// The graphs of a client's current sequence, one per device it ran on. They
+// are destroyed with it, once the sequence diverges or the client leaves.
+class Graphs {
+ public:
+  Graphs() = default;
+  ~Graphs();
+
+  Graphs(const Graphs &) = delete;
+  Graphs &operator=(const Graphs &) = delete;
+
+  // Runs an iteration of the sequence on the device as a graph, built the
+  // first time and updated with the launches' arguments after that, then
+  // writes back the Blocks it may have written
+  void run(Device &device, const std::vector<Launch> &batch, CUstream stream);
+
+ private:
+  struct Graph {
+    CUcontext context;
+    std::mutex mutex;  // held from setting the nodes until launched
+    CUgraph graph = nullptr;
+    CUgraphExec exec = nullptr;
+    std::vector<uint64_t> signatures;   // of the launches it was built for
+    std::vector<CUgraphNode> nodes;     // by launch, each after the last
+    std::vector<CUfunction> functions;  // that the nodes run
+
+    // Destroys what was built, if anything
+    void reset();
+  };
+
+  std::mutex mutex_;
+  std::unordered_map<CUdevice, std::unique_ptr<Graph>> graphs_;
+};
+
+}  // namespace weft::graph
+
+#endif  // WEFT_BACKEND_GRAPH_H
@@ -2,38 +2,255 @@
 
 #include <cuda.h>
 
-#include <boost/range/adaptor/indexed.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
 #include <functional>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <optional>
 #include <random>
+#include <stdexcept>
+#include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "CUDA_samples/helper_cuda_drvapi.h"
+#include "combine.h"
+#include "compiler.h"
+#include "fatbin.h"
 #include "memory.h"
+#include "pipeline.h"
+#include "ptx.h"
+#include "weft/cache.h"
+#include "weft/hash.h"
+#include "weft/image.h"
 namespace weft::kernel {
 
+// Added to by RPC threads and by launches that specialize a kernel. Entries are
+// never erased, so references stay valid outside the lock.
+static std::mutex registry_mutex;
 static std::unordered_map<uint64_t, Module> modules;
 static std::unordered_map<uint64_t, Function> functions;
 
+// Background JIT, so compiles overlap the client's allocations and uploads
+static boost::asio::thread_pool jit_pool;
+
 auto rand = std::bind(std::uniform_int_distribution<uint64_t>{},
                       std::mt19937(std::random_device{}()));
 
-uint64_t add_ptx(std::string ptx) {
+static std::string image_key(const std::string& hash) {
+  return to_hex(hash) + ".image";
+}
+
+Module::Module(uint64_t handle, Image image)
+    : handle_{handle}, hash_{weft::hash(image)}, image_{std::move(image)} {}
+
+void Module::compile(const std::vector<Device>& devices) const {
+  std::lock_guard<std::mutex> lock(loaded_mutex_);
+  for (const auto& device : devices) {
+    load(device);
+  }
+}
+
+CUmodule Module::get(const Device& device) const {
+  std::shared_future<CUmodule> module;
+  {
+    std::lock_guard<std::mutex> lock(loaded_mutex_);
+    module = load(device);
+  }
+
+  if (module.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+    auto start = std::chrono::steady_clock::now();
+    module.wait();
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::clog << "> JIT: " << handle_ << " waited " << elapsed.count()
+              << " ms on Device: " << device << "\n";
+  }
+  return module.get();
+}
+
+std::optional<CUmodule> Module::try_get(const Device& device) const {
+  std::shared_future<CUmodule> module;
+  {
+    std::lock_guard<std::mutex> lock(loaded_mutex_);
+    module = load(device);
+  }
+
+  if (module.wait_for(std::chrono::seconds(0)) != std::future_status::ready ||
+      !module.get()) {
+    return std::nullopt;
+  }
+  return module.get();
+}
+
+std::shared_future<CUmodule> Module::load(const Device& device) const {
+  auto it = loaded_.find(device);
+  if (it != loaded_.end()) return it->second;
+
+  auto task = std::make_shared<std::packaged_task<CUmodule()>>(
+      [this, &device] {
+        checkCudaErrors(cuCtxSetCurrent(device));
+        auto image = binary(device);
+        CUmodule module = nullptr;
+        if (!image.empty()) {
+          checkCudaErrors(cuModuleLoadData(&module, image.data()));
+        }
+        return module;
+      });
+  auto module = loaded_.emplace(device, task->get_future()).first->second;
+  boost::asio::post(jit_pool, [task] { (*task)(); });
+  return module;
+}
+
+std::string Module::binary(const Device& device) const {
+  switch (image_.type()) {
+    case Image::CUBIN:
+      return image_.data();
+    case Image::FATBIN:
+      if (auto entry =
+              fatbin::select(image_.data(), device.compute_capability())) {
+        std::clog << "> JIT: " << handle_ << " using fatbin "
+                  << (entry->is_ptx ? "compute_" : "sm_") << entry->arch
+                  << " for Device: " << device << "\n";
+        return entry->is_ptx ? jit(std::string(entry->data), device)
+                             : std::string(entry->data);
+      }
+      // Let the driver pick, e.g. from compressed entries
+      return image_.data();
+    case Image::CUDA: {
+      auto key = cubin_key(device);
+      if (auto cached = cache::load(key)) {
+        std::clog << "> JIT: " << handle_ << " cached for Device: " << device
+                  << " (" << key << ")\n";
+        return *cached;
+      }
+
+      auto start = std::chrono::steady_clock::now();
+      auto ptx = compiler::compile(image_, device.compute_capability());
+      if (!ptx) return {};
+
+      std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - start;
+      std::clog << "> NVRTC: " << handle_ << " compiled for Device: " << device
+                << " in " << elapsed.count() << " ms\n";
+      return jit(*ptx, device);
+    }
+    default:
+      return jit(image_.data(), device);
+  }
+}
+
+std::string Module::cubin_key(const Device& device) const {
+  // Bumped whenever the PTX rewrite changes, as it is baked into the cubins
+  constexpr int rewrite_version = 2;
+  return to_hex(hash_) + "-sm_" + std::to_string(device.compute_capability()) +
+         "-v" + std::to_string(rewrite_version) + ".cubin";
+}
+
+std::string Module::jit(const std::string& ptx, const Device& device) const {
+  auto key = cubin_key(device);
+  if (auto cached = cache::load(key)) {
+    std::clog << "> JIT: " << handle_ << " cached for Device: " << device
+              << " (" << key << ")\n";
+    return *cached;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  auto split = ptx::split(ptx);
+  for (const auto& entry : split.skipped) {
+    std::clog << "> Split: " << entry << " in " << handle_
+              << " cannot be split across devices\n";
+  }
+
+  char error_log[8192] = {};
+  std::vector<CUjit_option> options{CU_JIT_ERROR_LOG_BUFFER,
+                                    CU_JIT_ERROR_LOG_BUFFER_SIZE_BYTES};
+  std::vector<void*> option_values{error_log,
+                                   reinterpret_cast<void*>(sizeof(error_log))};
+  for (const auto& option : image_.options()) {
+    options.push_back(static_cast<CUjit_option>(option.option()));
+    option_values.push_back(reinterpret_cast<void*>(option.value()));
+  }
+
+  CUlinkState link;
+  checkCudaErrors(cuLinkCreate(options.size(), options.data(),
+                               option_values.data(), &link));
+  auto result = cuLinkAddData(link, CU_JIT_INPUT_PTX,
+                              const_cast<char*>(split.ptx.c_str()),
+                              split.ptx.size() + 1, nullptr, 0, nullptr,
+                              nullptr);
+  if (result != CUDA_SUCCESS) {
+    std::cerr << "> JIT: " << handle_ << " failed:\n" << error_log << "\n";
+  }
+  checkCudaErrors(result);
+
+  void* image;
+  size_t image_size;
+  checkCudaErrors(cuLinkComplete(link, &image, &image_size));
+  std::string cubin(static_cast<char*>(image), image_size);
+  checkCudaErrors(cuLinkDestroy(link));
+
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::clog << "> JIT: " << handle_ << " compiled for Device: " << device
+            << " in " << elapsed.count() << " ms (" << key << ")\n";
+
+  cache::store(key, cubin);
+  return cubin;
+}
+
+uint64_t add_image(Image image) {
+  std::unique_lock<std::mutex> lock(registry_mutex);
   auto handle = rand();
   while (modules.find(handle) != modules.end()) {
     handle = rand();
   }
 
-  modules.emplace(std::piecewise_construct, std::forward_as_tuple(handle),
-                  std::forward_as_tuple(handle, ptx));
+  auto& module =
+      modules
+          .emplace(std::piecewise_construct, std::forward_as_tuple(handle),
+                   std::forward_as_tuple(handle, std::move(image)))
+          .first->second;
+  lock.unlock();
+
+  // Keep the image so later clients can load it by hash alone
+  auto key = image_key(module.hash());
+  if (!cache::contains(key)) {
+    cache::store(key, module.image().SerializeAsString());
+  }
   return handle;
 }
 
+const Module& get_module(uint64_t m_handle) {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  return modules.at(m_handle);
+}
+
+std::optional<uint64_t> add_cached_image(const std::string& hash) {
+  auto data = cache::load(image_key(hash));
+  Image image;
+  if (!data || !image.ParseFromString(*data) || weft::hash(image) != hash) {
+    return std::nullopt;
+  }
+  return add_image(std::move(image));
+}
+
 const Function& get_function(uint64_t f_handle) {
+  std::lock_guard<std::mutex> lock(registry_mutex);
   return functions.at(f_handle);
 }
 
 const Function& add_function(uint64_t m_handle, std::string name,
                              std::vector<Param> params) {
+  std::lock_guard<std::mutex> lock(registry_mutex);
   auto const& module = modules.at(m_handle);
   auto f_handle = rand();
   while (functions.find(f_handle) != functions.end()) {
@@ -41,74 +258,517 @@ const Function& add_function(uint64_t m_handle, std::string name,
   }
 
   functions.emplace(std::piecewise_construct, std::forward_as_tuple(f_handle),
-                    std::forward_as_tuple(f_handle, module, name, params));
+                    std::forward_as_tuple(f_handle, module, std::move(name),
+                                          std::move(params)));
 
   return functions.at(f_handle);
 }
 
-void Function::execute(Device& device, const ExecutionArgs execution) const {
-  checkCudaErrors(cuCtxSetCurrent(device));
-
-  device.stream_pool.consume_one([&](const CUstream& stream) -> void {
-    std::clog << "> LaunchKernel: " << this->handle() << " (" << this->name()
-              << ") on Device: " << device << ", Stream: " << stream << "\n"
-              << "\t Grid — X: " << execution.gridDimX
-              << ", Y: " << execution.gridDimY << ", Z: " << execution.gridDimZ
-              << "\n"
-              << "\t Block — X: " << execution.blockDimX
-              << ", Y: " << execution.blockDimY
-              << ", Z: " << execution.blockDimZ << "\n"
-              << "\t Shared Memory: " << execution.sharedMemBytes << "\n";
-
-    CUmodule module;
-    checkCudaErrors(
-        cuModuleLoadDataEx(&module, this->module().ptx().c_str(), 0, 0, 0));
-    CUfunction kernel_addr;
-    checkCudaErrors(
-        cuModuleGetFunction(&kernel_addr, module, this->name().c_str()));
-
-    std::vector<void*> args;
-    for (const auto& param : execution.args | boost::adaptors::indexed(0)) {
-      void* ptr;
-      if (param.value().is_pointer()) {
-        auto& block = memory::get_block(*reinterpret_cast<uint64_t*>(
-            const_cast<char*>(param.value().data().c_str())));
-        auto d_ptr = block.device_ptr(device);  // Also cuMalloc's if we haven't
-
-        // NOTE: we'll also copy the const pointed data
-        // This allows us to perform the later consistency check on
-        // read-back if (param.value().is_const()) {
-        checkCudaErrors(
-            cuMemcpyHtoDAsync(*d_ptr, block.data(), block.size(), stream));
-        // }
-        ptr = reinterpret_cast<void*>(d_ptr);
-      } else {
-        ptr = reinterpret_cast<void*>(
-            const_cast<char*>(param.value().data().c_str()));
+LaunchPlan::LaunchPlan(const std::vector<Param>& params) {
+  size_t offset = 0;
+  auto add_slot = [&](size_t size, bool is_pointer, bool is_const,
+                      Access access) {
+    constexpr size_t align = alignof(std::max_align_t);
+    offset = (offset + align - 1) / align * align;
+    slots_.push_back({offset, size, is_pointer, is_const, access});
+    offset += size;
+  };
+
+  slots_.reserve(params.size() + hidden_slots);
+  for (const auto& param : params) {
+    add_slot(param.is_pointer ? sizeof(CUdeviceptr) : param.size,
+             param.is_pointer, param.is_const, param.access);
+  }
+  // _weft_blockOffset{X,Y,Z} and _weft_gridDim{X,Y,Z}
+  for (size_t i = 0; i < hidden_slots; ++i) {
+    add_slot(sizeof(uint32_t), false, true, FunctionMetadata::Param::READ_ONLY);
+  }
+  storage_size_ = offset;
+}
+
+LaunchPlan::Arguments& LaunchPlan::arguments(CUdevice device) const {
+  std::lock_guard<std::mutex> lock(arguments_mutex_);
+  auto& arguments = arguments_[device];
+  if (!arguments) arguments = std::make_unique<Arguments>(*this);
+  return *arguments;
+}
+
+LaunchPlan::Arguments::Arguments(const LaunchPlan& plan)
+    : plan_{plan},
+      storage_{std::make_unique<unsigned char[]>(plan.storage_size_)},
+      blocks_(plan.slots_.size()) {
+  merges.resize(plan.param_count());
+  written.reserve(plan.param_count());
+  merged.reserve(plan.param_count());
+  pointers_.reserve(plan.slots_.size());
+  for (const auto& slot : plan.slots_) {
+    pointers_.push_back(storage_.get() + slot.offset);
+  }
+}
+
+void LaunchPlan::Arguments::set(size_t slot, const void* value,
+                                size_t size) noexcept {
+  std::memcpy(pointers_[slot], value, std::min(size, plan_.slots_[slot].size));
+}
+
+memory::Block& LaunchPlan::Arguments::resolve(size_t slot, uint64_t handle) {
+  auto& resolved = blocks_[slot];
+  auto generation = memory::generation();
+  if (!resolved.block || resolved.handle != handle ||
+      resolved.generation != generation) {
+    resolved = {handle, generation, &memory::get_block(handle)};
+  }
+  return *resolved.block;
+}
+
+unsigned Function::split_axes(const std::vector<Device>& devices) const {
+  std::call_once(split_axes_once_, [&] {
+    split_axes_ = ptx::axis_x | ptx::axis_y | ptx::axis_z;
+    for (const auto& device : devices) {
+      checkCudaErrors(cuCtxSetCurrent(device));
+      auto module = module_.get(device);
+      CUdeviceptr marker;
+      size_t size;
+      uint32_t axes = 0;
+      if (!module ||
+          cuModuleGetGlobal(&marker, &size, module,
+                            ptx::split_marker(name_).c_str()) != CUDA_SUCCESS ||
+          cuMemcpyDtoH(&axes, marker, sizeof(axes)) != CUDA_SUCCESS) {
+        axes = 0;
       }
-      args.emplace_back(ptr);
+      split_axes_ &= axes;
+    }
+    std::clog << "> Split: " << name_
+              << (split_axes_ ? " is split across devices along"
+                              : " runs on a single device");
+    for (char axis : {'X', 'Y', 'Z'}) {
+      if (split_axes_ & (ptx::axis_x << (axis - 'X'))) std::clog << " " << axis;
+    }
+    std::clog << "\n";
+  });
+  return split_axes_;
+}
+
+void Function::observe(const ExecutionArgs& execution) const {
+  // Launches with the same scalars before a specialization is attempted
+  constexpr unsigned stable_threshold = 3;
 
-      std::clog << "\t " << param.index() << " - Size: " << param.value().size()
-                << ", Pointer: " << param.value().is_pointer()
-                << ", Const: " << param.value().is_const() << "\n";
+  const auto& image = module_.image();
+  if (image.type() != Image::CUDA || !image.specialize() ||
+      static_cast<size_t>(execution.args.size()) != params_.size()) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(specialization_mutex_);
+  if (stable_args_.empty()) {
+    stable_args_.resize(params_.size());
+    for (size_t i = 0; i < params_.size(); ++i) {
+      if (!params_[i].is_pointer) stable_args_[i] = execution.args[i].data();
     }
+  }
 
-    // Add _weft_blockOffset (assume last)
-    args.emplace_back(const_cast<int*>(&execution.blockOffset));
+  for (size_t i = 0; i < params_.size(); ++i) {
+    if (stable_args_[i] && *stable_args_[i] != execution.args[i].data()) {
+      std::clog << "> Specialize: " << name_ << " argument " << i
+                << " varies\n";
+      stable_args_[i].reset();
+      stable_launches_ = 0;
+      if (specialization_ && specialization_->constants[i]) {
+        specialization_.reset();
+      }
+    }
+  }
+
+  if (++stable_launches_ != stable_threshold || specialization_) return;
 
+  uint64_t key = fnv1a_seed;
+  bool any = false;
+  for (const auto& arg : stable_args_) {
+    key = fnv1a_value(arg.has_value(), key);
+    if (arg) {
+      key = fnv1a(*arg, key);
+      any = true;
+    }
+  }
+  if (!any) return;
+
+  auto it = specializations_.find(key);
+  if (it == specializations_.end()) {
+    std::shared_ptr<const Specialization> specialization;
+    if (auto src = compiler::specialize(image.data(), name_, stable_args_)) {
+      Image variant = image;
+      variant.set_data(*src);
+      variant.set_specialize(false);
+      auto handle = add_image(std::move(variant));
+      specialization = std::make_shared<const Specialization>(
+          Specialization{stable_args_, &get_module(handle)});
+      std::clog << "> Specialize: " << name_ << " as module " << handle
+                << "\n";
+    } else {
+      std::clog << "> Specialize: " << name_ << " cannot be specialized\n";
+    }
+    it = specializations_.emplace(key, std::move(specialization)).first;
+  }
+  specialization_ = it->second;
+}
+
+CUfunction Function::function(const Device& device,
+                              const ExecutionArgs& execution,
+                              LaunchPlan::Arguments& arguments) const {
+  if (!arguments.function) {
+    checkCudaErrors(cuModuleGetFunction(&arguments.function,
+                                        module_.get(device), name_.c_str()));
+  }
+
+  std::shared_ptr<const Specialization> specialization;
+  {
+    std::lock_guard<std::mutex> lock(specialization_mutex_);
+    specialization = specialization_;
+  }
+  if (!specialization) return arguments.function;
+
+  for (size_t i = 0; i < specialization->constants.size(); ++i) {
+    const auto& constant = specialization->constants[i];
+    if (constant && *constant != execution.args[i].data()) {
+      return arguments.function;
+    }
+  }
+
+  if (arguments.specialization != specialization.get()) {
+    // Keep launching the generic kernel until the variant is ready
+    auto module = specialization->module->try_get(device);
+    if (!module) return arguments.function;
+    checkCudaErrors(cuModuleGetFunction(&arguments.specialized_function,
+                                        *module, name_.c_str()));
+    arguments.specialization = specialization.get();
+  }
+  return arguments.specialized_function;
+}
+
+void Function::execute(Device& device, const ExecutionArgs& execution,
+                       CUstream stream, Timing* timing) const {
+  using clock = std::chrono::steady_clock;
+  auto called = clock::now();
+
+  if (static_cast<size_t>(execution.args.size()) != plan_.param_count()) {
+    throw std::invalid_argument(name_ + " expects " +
+                                std::to_string(plan_.param_count()) +
+                                " arguments, got " +
+                                std::to_string(execution.args.size()));
+  }
+
+  auto& arguments = plan_.arguments(device);
+  std::unique_lock<std::mutex> lock(arguments.mutex);
+  auto kernel = function(device, execution, arguments);
+
+  // Before the uploads, before the kernel and after it
+  std::array<std::optional<EventLease>, 3> events;
+  if (timing) {
+    for (auto& event : events) event.emplace(device.lease_event());
+    checkCudaErrors(cuEventRecord(*events[0], stream));
+  }
+
+  std::clog << "> LaunchKernel: " << handle_ << " (" << name_
+            << ") on Device: " << device << ", Stream: " << stream << "\n"
+            << "\t Grid — X: " << execution.gridDimX
+            << ", Y: " << execution.gridDimY << ", Z: " << execution.gridDimZ
+            << "\n"
+            << "\t Block — X: " << execution.blockDimX
+            << ", Y: " << execution.blockDimY << ", Z: " << execution.blockDimZ
+            << "\n"
+            << "\t Shared Memory: " << execution.sharedMemBytes << "\n"
+            << "\t Block Offset — X: " << execution.blockOffset[0]
+            << ", Y: " << execution.blockOffset[1]
+            << ", Z: " << execution.blockOffset[2] << "\n";
+
+  // Parts of a split launch accumulate into private memory where the kernel
+  // combines into its output, see combine.h
+  bool split = uint64_t{execution.gridDimX} * execution.gridDimY *
+                   execution.gridDimZ !=
+               uint64_t{execution.fullGridDim[0]} * execution.fullGridDim[1] *
+                   execution.fullGridDim[2];
+
+  const auto& slots = plan_.slots();
+  for (size_t i = 0; i < plan_.param_count(); ++i) {
+    const auto& data = execution.args[i].data();
+    auto& merge = arguments.merges[i];
+    merge = split && slots[i].writes()
+                ? combine::merger(execution.args[i].combine(),
+                                  execution.args[i].element())
+                : nullptr;
+    if (merge) {
+      uint64_t handle;
+      std::memcpy(&handle, data.data(), sizeof(handle));
+      auto& block = arguments.resolve(i, handle);
+      auto d_ptr = block.partial_ptr(device);
+      combine::fill_identity(*d_ptr, block.size(), execution.args[i].combine(),
+                             execution.args[i].element(), stream);
+      arguments.set(i, d_ptr, sizeof(*d_ptr));
+    } else if (slots[i].is_pointer) {
+      uint64_t handle;
+      std::memcpy(&handle, data.data(), sizeof(handle));
+      auto& block = arguments.resolve(i, handle);
+      auto d_ptr = block.device_ptr(device);  // Also cuMalloc's if we haven't
+
+      // Write-only buffers are uploaded too, as write_back diffs against
+      // the original data. Copies that are still current are skipped.
+      if (slots[i].access != FunctionMetadata::Param::UNUSED &&
+          block.upload(device, stream) && timing) {
+        timing->upload_bytes += block.size();
+      }
+      arguments.set(i, d_ptr, sizeof(*d_ptr));
+    } else {
+      arguments.set(i, data.data(), data.size());
+    }
+
+    std::clog << "\t " << i << " - Size: " << slots[i].size
+              << ", Pointer: " << slots[i].is_pointer
+              << ", Const: " << slots[i].is_const << ", Access: "
+              << FunctionMetadata::Param::Access_Name(slots[i].access);
+    if (merge) {
+      std::clog << ", Combine: "
+                << FunctionMetadata::Param::Combine_Name(
+                       execution.args[i].combine())
+                << " "
+                << FunctionMetadata::Param::Element_Name(
+                       execution.args[i].element());
+    }
+    std::clog << "\n";
+  }
+  for (size_t axis = 0; axis < 3; ++axis) {
+    arguments.set(plan_.block_offset_slot(axis), &execution.blockOffset[axis],
+                  sizeof(uint32_t));
+    arguments.set(plan_.grid_dim_slot(axis), &execution.fullGridDim[axis],
+                  sizeof(uint32_t));
+  }
+
+  if (timing) checkCudaErrors(cuEventRecord(*events[1], stream));
+  checkCudaErrors(cuLaunchKernel(
+      kernel, execution.gridDimX, execution.gridDimY, execution.gridDimZ,
+      execution.blockDimX, execution.blockDimY, execution.blockDimZ,
+      execution.sharedMemBytes, stream, const_cast<void**>(arguments.data()),
+      nullptr));
+  if (timing) checkCudaErrors(cuEventRecord(*events[2], stream));
+
+  // The driver has copied the arguments, so launches of this kernel on
+  // other streams need not wait for the write back
+  std::unique_lock<std::mutex> write_back_lock(arguments.write_back_mutex);
+  auto& written = arguments.written;
+  auto& merged = arguments.merged;
+  written.clear();
+  merged.clear();
+  for (size_t i = 0; i < plan_.param_count(); ++i) {
+    if (auto merge = arguments.merges[i]) {
+      merged.emplace_back(&arguments.block(i), merge);
+    } else if (slots[i].writes()) {
+      written.push_back(&arguments.block(i));
+    }
+  }
+  lock.unlock();
+
+  checkCudaErrors(cuStreamSynchronize(stream));
+  auto kernel_done = clock::now();
+  for (auto* block : written) {
+    block->write_back(device, stream);
+  }
+  for (auto [block, merge] : merged) {
+    block->combine(device, stream, merge);
+  }
+
+  if (!timing) return;
+  std::chrono::duration<float, std::milli> write_back =
+      clock::now() - kernel_done;
+  std::chrono::duration<float, std::milli> total = clock::now() - called;
+  timing->total_ms = total.count();
+  timing->write_back_ms = write_back.count();
+  for (auto* block : written) timing->write_back_bytes += block->size();
+  for (const auto& part : merged) {
+    timing->write_back_bytes += part.first->size();
+  }
+  checkCudaErrors(
+      cuEventElapsedTime(&timing->upload_ms, *events[0], *events[1]));
+  checkCudaErrors(
+      cuEventElapsedTime(&timing->kernel_ms, *events[1], *events[2]));
+}
+
+bool Function::execute_pipelined(Device& device,
+                                 const ExecutionArgs& execution,
+                                 CUstream stream, unsigned waves) const {
+  using clock = std::chrono::steady_clock;
+  auto called = clock::now();
+
+  if (static_cast<size_t>(execution.args.size()) != plan_.param_count() ||
+      execution.gridDimY != 1 || execution.gridDimZ != 1 ||
+      execution.fullGridDim[1] != 1 || execution.fullGridDim[2] != 1 ||
+      execution.blockDimY != 1 || execution.blockDimZ != 1 ||
+      execution.gridDimX < 2) {
+    return false;
+  }
+
+  // Buffers to copy by wave, with the bytes of each element
+  struct Buffer {
+    memory::Block* block;
+    size_t element_size;
+    bool upload;
+    bool download;
+  };
+  std::vector<Buffer> buffers;
+
+  auto& arguments = plan_.arguments(device);
+  std::unique_lock<std::mutex> lock(arguments.mutex);
+  uint64_t threads =
+      uint64_t{execution.fullGridDim[0]} * execution.blockDimX;
+  const auto& slots = plan_.slots();
+  for (size_t i = 0; i < plan_.param_count(); ++i) {
+    const auto& arg = execution.args[i];
+    if (!slots[i].is_pointer) continue;
+    uint64_t handle;
+    std::memcpy(&handle, arg.data().data(), sizeof(handle));
+    auto& block = arguments.resolve(i, handle);
+    if (slots[i].access == FunctionMetadata::Param::UNUSED) continue;
+
+    // Only the client knows the kernel indexes the buffer by thread; the
+    // size just gives the bytes per element
+    if (!arg.elementwise() || arg.combine() != FunctionMetadata::Param::NONE) {
+      return false;
+    }
+    auto element_size = pipeline::element_size(
+        block.size(), arg.pointee_size(), threads, execution.blockDimX);
+    if (!element_size) return false;
+    // As in execute, written buffers are uploaded too
+    buffers.push_back({&block, element_size, !block.current(device),
+                       slots[i].writes()});
+  }
+
+  auto kernel = function(device, execution, arguments);
+  for (size_t i = 0; i < plan_.param_count(); ++i) {
+    const auto& data = execution.args[i].data();
+    if (slots[i].is_pointer) {
+      auto d_ptr = arguments.block(i).device_ptr(device);
+      arguments.set(i, d_ptr, sizeof(*d_ptr));
+    } else {
+      arguments.set(i, data.data(), data.size());
+    }
+  }
+  for (size_t axis = 0; axis < 3; ++axis) {
+    arguments.set(plan_.grid_dim_slot(axis), &execution.fullGridDim[axis],
+                  sizeof(uint32_t));
+  }
+  for (auto& buffer : buffers) {
+    if (buffer.upload || buffer.download) buffer.block->pin();
+  }
+
+  // The waves rotate over the launch's own stream and whichever others are
+  // free now, which start after the work queued on it; never waiting for a
+  // stream while holding one
+  std::vector<StreamLease> extra;
+  std::vector<CUstream> lanes{stream};
+  {
+    auto queued = device.lease_event();
+    checkCudaErrors(cuEventRecord(queued, stream));
+    while (lanes.size() < std::min<size_t>(pipeline::streams, waves)) {
+      auto lease = device.try_lease_stream();
+      if (!lease) break;
+      checkCudaErrors(cuStreamWaitEvent(*lease, queued, 0));
+      lanes.push_back(*lease);
+      extra.push_back(std::move(*lease));
+    }
+  }
+
+  auto cut = pipeline::cut(execution.blockOffset[0], execution.gridDimX,
+                           waves);
+  for (size_t wave = 0; wave < cut.size(); ++wave) {
+    auto [offset, blocks] = cut[wave];
+    CUstream lane = lanes[wave % lanes.size()];
+
+    // Bytes of a buffer that the wave's threads index
+    auto range = [&](const Buffer& buffer) {
+      auto size = buffer.block->size();
+      auto per_block = uint64_t{execution.blockDimX} * buffer.element_size;
+      auto begin = std::min<uint64_t>(size, offset * per_block);
+      auto end = std::min<uint64_t>(size, (offset + blocks) * per_block);
+      return std::make_pair(begin, end - begin);
+    };
+
+    for (const auto& buffer : buffers) {
+      auto [begin, bytes] = range(buffer);
+      if (buffer.upload && bytes) {
+        buffer.block->upload(device, lane, begin, bytes);
+      }
+    }
+    arguments.set(plan_.block_offset_slot(0), &offset, sizeof(uint32_t));
+    uint32_t zero = 0;
+    arguments.set(plan_.block_offset_slot(1), &zero, sizeof(uint32_t));
+    arguments.set(plan_.block_offset_slot(2), &zero, sizeof(uint32_t));
     checkCudaErrors(cuLaunchKernel(
-        kernel_addr, execution.gridDimX, execution.gridDimY, execution.gridDimZ,
-        execution.blockDimX, execution.blockDimY, execution.blockDimZ,
-        execution.sharedMemBytes, stream, args.data(), nullptr));
-
-    for (const auto& param : execution.args) {
-      if (param.is_pointer() && !param.is_const()) {
-        memory::get_block(*reinterpret_cast<uint64_t*>(
-                              const_cast<char*>(param.data().c_str())))
-            .write_back(device, stream);
+        kernel, blocks, 1, 1, execution.blockDimX, execution.blockDimY,
+        execution.blockDimZ, execution.sharedMemBytes, lane,
+        const_cast<void**>(arguments.data()), nullptr));
+    for (const auto& buffer : buffers) {
+      auto [begin, bytes] = range(buffer);
+      if (buffer.download && bytes) {
+        buffer.block->download(device, lane, begin, bytes);
       }
     }
-  });
+  }
+  lock.unlock();
+
+  for (auto lane : lanes) checkCudaErrors(cuStreamSynchronize(lane));
+  bool whole = execution.gridDimX == execution.fullGridDim[0];
+  for (const auto& buffer : buffers) {
+    if (buffer.upload || buffer.download) {
+      buffer.block->copied(device, buffer.download, whole);
+    }
+  }
+
+  std::chrono::duration<double, std::milli> elapsed = clock::now() - called;
+  std::clog << "> Pipeline: " << handle_ << " (" << name_ << ") on Device: "
+            << device << ", " << execution.gridDimX << " blocks in "
+            << cut.size() << " waves over " << lanes.size() << " streams, "
+            << elapsed.count() << " ms\n";
+  return true;
+}
+
+std::vector<memory::Block*> Function::bind(
+    Device& device, const ExecutionArgs& execution, CUstream stream,
+    const std::function<void(CUfunction, void**)>& use) const {
+  if (static_cast<size_t>(execution.args.size()) != plan_.param_count()) {
+    throw std::invalid_argument(name_ + " expects " +
+                                std::to_string(plan_.param_count()) +
+                                " arguments");
+  }
+
+  auto& arguments = plan_.arguments(device);
+  std::lock_guard<std::mutex> lock(arguments.mutex);
+  auto kernel = function(device, execution, arguments);
+
+  std::vector<memory::Block*> written;
+  const auto& slots = plan_.slots();
+  for (size_t i = 0; i < plan_.param_count(); ++i) {
+    const auto& data = execution.args[i].data();
+    if (slots[i].is_pointer) {
+      uint64_t handle;
+      std::memcpy(&handle, data.data(), sizeof(handle));
+      auto& block = arguments.resolve(i, handle);
+      auto d_ptr = block.device_ptr(device);
+      if (slots[i].access != FunctionMetadata::Param::UNUSED) {
+        block.upload(device, stream);
+      }
+      if (slots[i].writes()) written.push_back(&block);
+      arguments.set(i, d_ptr, sizeof(*d_ptr));
+    } else {
+      arguments.set(i, data.data(), data.size());
+    }
+  }
+  for (size_t axis = 0; axis < 3; ++axis) {
+    arguments.set(plan_.block_offset_slot(axis), &execution.blockOffset[axis],
+                  sizeof(uint32_t));
+    arguments.set(plan_.grid_dim_slot(axis), &execution.fullGridDim[axis],
+                  sizeof(uint32_t));
+  }
+
+  use(kernel, const_cast<void**>(arguments.data()));
+  return written;
 }
 
 }  // namespace weft::kernel
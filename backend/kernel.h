@@ -1,38 +1,80 @@
 #ifndef WEFT_BACKEND_KERNEL_H
 #define WEFT_BACKEND_KERNEL_H
 
+#include <cuda.h>
 #include <google/protobuf/repeated_field.h>
 
+#include <array>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "combine.h"
 #include "device.h"
+#include "memory.h"
 #include "weft.grpc.pb.h"
 
 namespace weft::kernel {
 
 class Module {
  public:
-  Module(uint64_t handle, std::string ptx)
-      : handle_{handle}, ptx_{std::move(ptx)} {}
+  Module(uint64_t handle, Image image);
+
+  Module(const Module &) = delete;
+  Module &operator=(const Module &) = delete;
 
   constexpr uint64_t handle() const noexcept { return handle_; }
-  std::string ptx() const noexcept { return ptx_; }
+  // SHA-256 of the image, see weft::hash(Image)
+  const std::string &hash() const noexcept { return hash_; }
+  const Image &image() const noexcept { return image_; }
+
+  // Starts loading the module on each device in the JIT thread pool. Cubins
+  // load as is and fatbins use the entry matching the device's architecture.
+  // PTX (including NVRTC output for source images) is rewritten so kernels can
+  // be split across devices, then JIT output is cached on disk by image hash
+  // and compute capability, so only the first load for an architecture
+  // ever compiles.
+  void compile(const std::vector<Device> &devices) const;
+
+  // Loaded module for the device, blocking only while its compile is running
+  CUmodule get(const Device &device) const;
+
+  // Loaded module if its compile for the device has finished (and succeeded)
+  std::optional<CUmodule> try_get(const Device &device) const;
 
  private:
   uint64_t handle_;
-  std::string ptx_;
+  std::string hash_;
+  Image image_;
+
+  mutable std::mutex loaded_mutex_;
+  mutable std::unordered_map<CUdevice, std::shared_future<CUmodule>> loaded_;
+
+  std::shared_future<CUmodule> load(const Device &device) const;
+  std::string binary(const Device &device) const;
+  std::string jit(const std::string &ptx, const Device &device) const;
+  std::string cubin_key(const Device &device) const;
 };
 
+using Access = FunctionMetadata::Param::Access;
+
 struct Param {
   size_t size;
   bool is_pointer;
   bool is_const;
+  Access access;  // of the pointee
 
-  Param(size_t size, bool is_pointer, bool is_const)
-      : size{size}, is_pointer{is_pointer}, is_const{is_const} {}
+  Param(size_t size, bool is_pointer, bool is_const, Access access)
+      : size{size},
+        is_pointer{is_pointer},
+        is_const{is_const},
+        access{access} {}
 };
 
 struct ExecutionArgs {
@@ -44,7 +86,8 @@ struct ExecutionArgs {
   uint32_t blockDimZ;
   uint32_t sharedMemBytes;
   const google::protobuf::RepeatedPtrField<weft::FunctionMetadata_Param> &args;
-  int blockOffset;
+  std::array<uint32_t, 3> blockOffset;  // of this slice of the grid, by axis
+  std::array<uint32_t, 3> fullGridDim;  // of the launch before it was split
 
   ExecutionArgs(const KernelLaunch &request)
       : gridDimX{request.griddimx()},
@@ -55,7 +98,108 @@ struct ExecutionArgs {
         blockDimZ{request.blockdimz()},
         sharedMemBytes{request.sharedmembytes()},
         args{request.params()},
-        blockOffset{0} {}
+        blockOffset{0, 0, 0},
+        fullGridDim{request.griddimx(), request.griddimy(),
+                    request.griddimz()} {}
+};
+
+// Where the time of one Function::execute went
+struct Timing {
+  float total_ms = 0;  // on the host, from the call until it returns
+  float upload_ms = 0;
+  float kernel_ms = 0;
+  float write_back_ms = 0;
+  size_t upload_bytes = 0;  // of Blocks that were not current on the device
+  size_t write_back_bytes = 0;
+};
+
+// Argument layout of a Function, fixed once at ModuleGetFunction time. Each
+// device gets preallocated argument storage and a kernelParams array pointing
+// into it, so a launch only copies argument bytes and allocates nothing.
+class LaunchPlan {
+ public:
+  struct Slot {
+    size_t offset;  // into the argument storage
+    size_t size;
+    bool is_pointer;
+    bool is_const;
+    Access access;
+
+    // Whether the launch may change the pointee, so it must be written back
+    bool writes() const noexcept {
+      return is_pointer && !is_const &&
+             (access == FunctionMetadata::Param::READ_WRITE ||
+              access == FunctionMetadata::Param::WRITE_ONLY);
+    }
+  };
+
+  class Arguments {
+   public:
+    explicit Arguments(const LaunchPlan &plan);
+
+    std::mutex mutex;  // held until the kernel is queued
+    CUfunction function = nullptr;
+    CUfunction specialized_function = nullptr;
+    const void *specialization = nullptr;  // that specialized_function is for
+
+    // How parts of a split launch merge into each parameter, null unless
+    // they do, see combine.h. Set under `mutex`.
+    std::vector<combine::Merge> merges;
+
+    // Held from before `mutex` is released until the launch has written back
+    // `written` and merged into `merged`, which have room for every
+    // parameter. So the next launch on the device queues its kernel
+    // meanwhile and only then waits.
+    std::mutex write_back_mutex;
+    std::vector<memory::Block *> written;
+    std::vector<std::pair<memory::Block *, combine::Merge>> merged;
+
+    void *const *data() noexcept { return pointers_.data(); }
+    void set(size_t slot, const void *value, size_t size) noexcept;
+
+    // Block behind a pointer argument, memoized until the handle changes or
+    // any Block is freed
+    memory::Block &resolve(size_t slot, uint64_t handle);
+    memory::Block &block(size_t slot) noexcept { return *blocks_[slot].block; }
+
+   private:
+    struct ResolvedBlock {
+      uint64_t handle = 0;
+      uint64_t generation = 0;
+      memory::Block *block = nullptr;
+    };
+
+    const LaunchPlan &plan_;
+    std::unique_ptr<unsigned char[]> storage_;
+    std::vector<void *> pointers_;
+    std::vector<ResolvedBlock> blocks_;
+  };
+
+  explicit LaunchPlan(const std::vector<Param> &params);
+
+  LaunchPlan(const LaunchPlan &) = delete;
+  LaunchPlan &operator=(const LaunchPlan &) = delete;
+
+  const std::vector<Slot> &slots() const noexcept { return slots_; }
+  size_t param_count() const noexcept { return slots_.size() - hidden_slots; }
+  size_t block_offset_slot(size_t axis) const noexcept {
+    return param_count() + axis;
+  }
+  size_t grid_dim_slot(size_t axis) const noexcept {
+    return param_count() + 3 + axis;
+  }
+
+  Arguments &arguments(CUdevice device) const;
+
+ private:
+  // Parameters appended by ptx::split
+  static constexpr size_t hidden_slots = 6;
+
+  std::vector<Slot> slots_;  // params, then the hidden ones
+  size_t storage_size_;
+
+  mutable std::mutex arguments_mutex_;
+  mutable std::unordered_map<CUdevice, std::unique_ptr<Arguments>> arguments_;
 };
 
 class Function {
@@ -65,23 +209,76 @@ class Function {
       : handle_{handle},
         module_{module},
         name_{std::move(name)},
-        params_{std::move(params)} {}
+        params_{std::move(params)},
+        plan_{params_} {}
+
+  Function(const Function &) = delete;
+  Function &operator=(const Function &) = delete;
 
   constexpr uint64_t handle() const noexcept { return handle_; }
   const Module &module() const noexcept { return module_; }
-  std::string name() const noexcept { return name_; }
+  const std::string &name() const noexcept { return name_; }
   const std::vector<Param> &params() const noexcept { return params_; }
 
-  void execute(Device &device, const ExecutionArgs execution) const;
+  // Tracks scalar arguments across launches. For source modules built with
+  // specialize, once they have been stable for a few launches a variant with
+  // them baked in is compiled in the background.
+  void observe(const ExecutionArgs &execution) const;
+
+  // Axes (a ptx::axis_* mask) along which the kernel was rewritten on every
+  // device to run a part of its grid, 0 if none. Waits for the module to load
+  // on the devices the first time.
+  unsigned split_axes(const std::vector<Device> &devices) const;
+
+  // Returns once the kernel has finished and its results are written back.
+  // Fills in the timing, if any, with events around the upload and kernel.
+  // Throws std::invalid_argument if the arguments do not match the kernel.
+  void execute(Device &device, const ExecutionArgs &execution,
+               CUstream stream, Timing *timing = nullptr) const;
+
+  // Runs a 1-D launch, or slice of one, as waves of blocks rotating over
+  // `stream` and any free streams of the device, see pipeline.h. The kernel
+  // must have been split along x. Returns false without running anything
+  // unless the client declared every buffer it uses elementwise and each has
+  // one element per thread. Returns once the results are back.
+  bool execute_pipelined(Device &device, const ExecutionArgs &execution,
+                         CUstream stream, unsigned waves) const;
+
+  // Uploads the Blocks of an unsplit launch and hands its kernel and
+  // arguments to `use` while they are locked, e.g. to set a graph node to
+  // it. Returns the Blocks it may write, to write back once it has run.
+  std::vector<memory::Block *> bind(
+      Device &device, const ExecutionArgs &execution, CUstream stream,
+      const std::function<void(CUfunction, void **)> &use) const;
 
  private:
   uint64_t handle_;
   const Module &module_;
   std::string name_;
   std::vector<Param> params_;
+  LaunchPlan plan_;
+
+  mutable std::once_flag split_axes_once_;
+  mutable unsigned split_axes_ = 0;
+
+  struct Specialization {
+    std::vector<std::optional<std::string>> constants;
+    const Module *module;
+  };
+  mutable std::mutex specialization_mutex_;
+  mutable std::vector<std::optional<std::string>> stable_args_;
+  mutable unsigned stable_launches_ = 0;
+  mutable std::shared_ptr<const Specialization> specialization_;
+  mutable std::unordered_map<uint64_t, std::shared_ptr<const Specialization>>
+      specializations_;  // by hash of constants
+
+  CUfunction function(const Device &device, const ExecutionArgs &execution,
+                      LaunchPlan::Arguments &arguments) const;
 };
 
-uint64_t add_ptx(std::string ptx);
+uint64_t add_image(Image image);
+std::optional<uint64_t> add_cached_image(const std::string &hash);
+const Module &get_module(uint64_t m_handle);
 
 const Function &get_function(uint64_t f_handle);
 const Function &add_function(uint64_t m_handle, std::string name,
@@ -0,0 +1,170 @@
+#include "memo.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "kernel.h"
+#include "memory.h"
+#include "weft/hash.h"
+
+namespace weft::memo {
+
+namespace {
+
+struct Output {
+  size_t param;  // index of the pointer argument
+  std::string data;
+};
+
+struct Entry {
+  std::vector<Output> outputs;
+  size_t bytes;     // of outputs
+  size_t transfer;  // uploads and write backs a replay avoids, at most
+  std::list<std::string>::iterator lru;
+};
+
+}  // namespace
+
+static std::mutex memo_mutex;
+static std::unordered_map<std::string, Entry> entries;
+static std::list<std::string> lru;  // keys, most recently used first
+static size_t stored_bytes = 0;
+
+static uint64_t hits = 0;
+static uint64_t misses = 0;
+static uint64_t bytes_saved = 0;
+
+static size_t capacity() {
+  static const size_t bytes = [] {
+    const char* mib = std::getenv("WEFT_MEMOIZE");
+    size_t bytes = mib ? std::strtoull(mib, nullptr, 10) << 20 : 0;
+    if (bytes) {
+      std::clog << "> Memo: keeping up to " << (bytes >> 20)
+                << " MiB of launch results\n";
+    }
+    return bytes;
+  }();
+  return bytes;
+}
+
+bool enabled() { return capacity() != 0; }
+
+static uint64_t block_handle(const std::string& data) {
+  uint64_t handle = 0;
+  std::memcpy(&handle, data.data(), std::min(sizeof(handle), data.size()));
+  return handle;
+}
+
+static bool writes(const kernel::Param& param) {
+  return param.is_pointer && !param.is_const &&
+         (param.access == FunctionMetadata::Param::READ_WRITE ||
+          param.access == FunctionMetadata::Param::WRITE_ONLY);
+}
+
+// Called with memo_mutex held
+static void log(const kernel::Function& func, bool hit) {
+  std::clog << "> Memo: " << func.name() << (hit ? " hit" : " miss") << ", "
+            << hits << "/" << hits + misses << " launches replayed ("
+            << 100 * hits / (hits + misses) << "%), " << bytes_saved
+            << " bytes of transfers saved\n";
+}
+
+std::optional<std::string> key(const kernel::Function& func,
+                               const kernel::ExecutionArgs& execution) {
+  const auto& params = func.params();
+  if (static_cast<size_t>(execution.args.size()) != params.size()) {
+    return std::nullopt;
+  }
+
+  Sha256 key;
+  key.update(func.module().hash()).update_field(func.name());
+  for (auto dim : {execution.gridDimX, execution.gridDimY, execution.gridDimZ,
+                   execution.blockDimX, execution.blockDimY,
+                   execution.blockDimZ, execution.sharedMemBytes}) {
+    key.update_value(dim);
+  }
+
+  for (size_t i = 0; i < params.size(); ++i) {
+    const auto& data = execution.args[i].data();
+    if (!params[i].is_pointer) {
+      key.update_field(data);
+    } else if (params[i].access != FunctionMetadata::Param::UNUSED) {
+      // Output Blocks count too, as bytes the kernel leaves alone keep
+      // their contents
+      auto& block = memory::get_block(block_handle(data));
+      key.update_value(block.size()).update(block.hash());
+    }
+  }
+  return key.digest();
+}
+
+bool replay(const std::string& key, const kernel::Function& func,
+            const kernel::ExecutionArgs& execution) {
+  std::lock_guard<std::mutex> lock(memo_mutex);
+  auto it = entries.find(key);
+  if (it == entries.end()) {
+    ++misses;
+    log(func, false);
+    return false;
+  }
+
+  auto& entry = it->second;
+  for (const auto& output : entry.outputs) {
+    auto& block =
+        memory::get_block(block_handle(execution.args[output.param].data()));
+    std::memcpy(block.data(), output.data.data(),
+                std::min(block.size(), output.data.size()));
+    block.modified();
+  }
+  lru.splice(lru.begin(), lru, entry.lru);
+
+  ++hits;
+  bytes_saved += entry.transfer;
+  log(func, true);
+  return true;
+}
+
+void record(const std::string& key, const kernel::Function& func,
+            const kernel::ExecutionArgs& execution) {
+  const auto& params = func.params();
+  Entry entry{{}, 0, 0, {}};
+  for (size_t i = 0; i < params.size(); ++i) {
+    if (!params[i].is_pointer ||
+        params[i].access == FunctionMetadata::Param::UNUSED) {
+      continue;
+    }
+    auto& block = memory::get_block(block_handle(execution.args[i].data()));
+    entry.transfer += block.size();
+    if (writes(params[i])) {
+      const auto* data = static_cast<const char*>(block.data());
+      entry.outputs.push_back({i, std::string(data, block.size())});
+      entry.bytes += block.size();
+      entry.transfer += block.size();
+    }
+  }
+  if (entry.bytes > capacity()) return;
+
+  std::lock_guard<std::mutex> lock(memo_mutex);
+  if (entries.count(key)) return;  // recorded by a concurrent launch
+  while (!lru.empty() && stored_bytes + entry.bytes > capacity()) {
+    auto evicted = entries.find(lru.back());
+    stored_bytes -= evicted->second.bytes;
+    entries.erase(evicted);
+    lru.pop_back();
+  }
+  stored_bytes += entry.bytes;
+  lru.push_front(key);
+  entry.lru = lru.begin();
+  entries.emplace(key, std::move(entry));
+}
+
+}  // namespace weft::memo
@@ -0,0 +1,34 @@
+#ifndef WEFT_BACKEND_MEMO_H
+#define WEFT_BACKEND_MEMO_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "kernel.h"
+
+// Opt-in cache of launch results for pipelines that re-run deterministic
+// kernels on the same inputs. Enabled by WEFT_MEMOIZE=<MiB of results kept>.
+namespace weft::memo {
+
+bool enabled();
+
+// Identifies a launch by kernel (module hash and name, so it holds across
+// clients), geometry, scalar arguments and the contents of the Blocks it is
+// given, as a SHA-256: a hit is trusted without comparing the inputs.
+// Nullopt if the launch cannot be memoized.
+std::optional<std::string> key(const kernel::Function& func,
+                               const kernel::ExecutionArgs& execution);
+
+// Writes the results of an earlier launch with the key into the Blocks the
+// kernel writes, instead of launching it. False on a miss.
+bool replay(const std::string& key, const kernel::Function& func,
+            const kernel::ExecutionArgs& execution);
+
+// Keeps the contents of the Blocks the kernel wrote, after the launch
+void record(const std::string& key, const kernel::Function& func,
+            const kernel::ExecutionArgs& execution);
+
+}  // namespace weft::memo
+
+#endif  // WEFT_BACKEND_MEMO_H
@@ -2,29 +2,81 @@
 
 #include <cuda.h>
 
+#include <atomic>
 #include <cstring>
 #include <functional>
 #include <iostream>
 #include <mutex>
 #include <random>
+#include <shared_mutex>
+#include <string_view>
 #include <unordered_map>
 
 #include "CUDA_samples/helper_cuda_drvapi.h"
+#include "weft/hash.h"
 namespace weft::memory {
 
+// Launches run on the scheduler's thread while allocations arrive, so the map
+// is locked; Blocks themselves never move
+static std::shared_mutex mmap_mutex;
 static std::unordered_map<uint64_t, Block> mmap;
+static std::atomic<uint64_t> mmap_generation{0};
+static std::atomic<uint64_t> device_allocations{0};
 
 auto rand = std::bind(std::uniform_int_distribution<uint64_t>{},
                       std::mt19937(std::random_device{}()));
 
+Block::DeviceCopy& Block::device_copy(CUdevice device) {
+  std::lock_guard<std::mutex> lock(device_copies_mutex_);
+  return device_copies_[device];
+}
+
 CUdeviceptr* Block::device_ptr(CUdevice device) {
-  auto* ptr = &device_ptrs_[device];
-  if (!*ptr) cuMemAlloc(ptr, size_);
+  auto* ptr = &device_copy(device).ptr;
+  if (!*ptr) {
+    cuMemAlloc(ptr, size_);
+    device_allocations.fetch_add(1, std::memory_order_relaxed);
+  }
   return ptr;
 }
 
+bool Block::allocated(CUdevice device) {
+  std::lock_guard<std::mutex> lock(device_copies_mutex_);
+  auto it = device_copies_.find(device);
+  return it != device_copies_.end() && it->second.ptr;
+}
+
+bool Block::current(CUdevice device) {
+  std::lock_guard<std::mutex> lock(device_copies_mutex_);
+  auto it = device_copies_.find(device);
+  return it != device_copies_.end() &&
+         it->second.version == version_.load(std::memory_order_relaxed);
+}
+
+bool Block::upload(CUdevice device, CUstream stream) {
+  auto& copy = device_copy(device);
+  auto version = version_.load(std::memory_order_relaxed);
+  if (copy.version == version) return false;
+
+  checkCudaErrors(cuMemcpyHtoDAsync(copy.ptr, data_.get(), size_, stream));
+  copy.version = version;
+  return true;
+}
+
+std::string Block::hash() {
+  std::lock_guard<std::mutex> lock(hash_mutex_);
+  auto version = version_.load(std::memory_order_relaxed);
+  if (hash_version_ != version) {
+    hash_ =
+        sha256(std::string_view(reinterpret_cast<char*>(data_.get()), size_));
+    hash_version_ = version;
+  }
+  return hash_;
+}
+
 void Block::write_back(const CUdevice& device, const CUstream& stream) {
-  auto* d_ptr = &device_ptrs_[device];
+  auto& copy = device_copy(device);
+  copy.version = 0;  // the kernel may have changed it
 
   // Thread-safe copy original
   std::call_once(orig_data_init_, [&]() {
@@ -32,19 +84,78 @@ void Block::write_back(const CUdevice& device, const CUstream& stream) {
     std::memcpy(orig_data_.get(), data_.get(), size_);
   });
 
-  // Copy to temp buffer
-  auto buf = std::make_unique<unsigned char[]>(size_);
-  checkCudaErrors(cuMemcpyDtoHAsync(buf.get(), *d_ptr, size_, stream));
+  // Copy to staging buffer (kept across launches)
+  if (!copy.staging) copy.staging = std::make_unique<unsigned char[]>(size_);
+  auto* buf = copy.staging.get();
+  checkCudaErrors(cuMemcpyDtoHAsync(buf, copy.ptr, size_, stream));
 
   // Check consistency and perform real copy
+  bool changed = false;
   for (size_t i = 0; i < size_; ++i) {
-    if (orig_data_.get()[i] != buf[i]) {
+    if (orig_data_.get()[i] != buf[i] && data_.get()[i] != buf[i]) {
       data_.get()[i] = buf[i];
+      changed = true;
     }
   }
+  if (changed) modified();
+}
+
+void Block::pin() {
+  std::call_once(pin_once_, [&] {
+    pinned_ = cuMemHostRegister(data_.get(), size_,
+                                CU_MEMHOSTREGISTER_PORTABLE) == CUDA_SUCCESS;
+  });
+}
+
+void Block::upload(CUdevice device, CUstream stream, size_t offset,
+                   size_t bytes) {
+  auto& copy = device_copy(device);
+  checkCudaErrors(cuMemcpyHtoDAsync(copy.ptr + offset, data_.get() + offset,
+                                    bytes, stream));
+}
+
+void Block::download(CUdevice device, CUstream stream, size_t offset,
+                     size_t bytes) {
+  auto& copy = device_copy(device);
+  checkCudaErrors(cuMemcpyDtoHAsync(data_.get() + offset, copy.ptr + offset,
+                                    bytes, stream));
+}
+
+void Block::copied(CUdevice device, bool downloaded, bool whole) {
+  if (downloaded) modified();
+  auto& copy = device_copy(device);
+  if (whole) {
+    copy.version = version_.load(std::memory_order_relaxed);
+  } else if (downloaded) {
+    copy.version = 0;
+  }
+}
+
+CUdeviceptr* Block::partial_ptr(CUdevice device) {
+  auto* ptr = &device_copy(device).partial;
+  if (!*ptr) {
+    checkCudaErrors(cuMemAlloc(ptr, size_));
+    device_allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+  return ptr;
+}
+
+void Block::combine(CUdevice device, CUstream stream,
+                    void (*merge)(void* into, const void* partial,
+                                  size_t bytes)) {
+  auto& copy = device_copy(device);
+  if (!copy.staging) copy.staging = std::make_unique<unsigned char[]>(size_);
+  checkCudaErrors(
+      cuMemcpyDtoHAsync(copy.staging.get(), copy.partial, size_, stream));
+  checkCudaErrors(cuStreamSynchronize(stream));
+
+  std::lock_guard<std::mutex> lock(combine_mutex_);
+  merge(data_.get(), copy.staging.get(), size_);
+  modified();
 }
 
 uint64_t malloc(size_t size) {
+  std::unique_lock<std::shared_mutex> lock(mmap_mutex);
   auto handle = rand();
   while (mmap.find(handle) != mmap.end()) {
     handle = rand();
@@ -55,8 +166,24 @@ uint64_t malloc(size_t size) {
   return handle;
 }
 
-Block& get_block(uint64_t handle) { return mmap.at(handle); }
+Block& get_block(uint64_t handle) {
+  std::shared_lock<std::shared_mutex> lock(mmap_mutex);
+  return mmap.at(handle);
+}
 
-void free(uint64_t handle) { mmap.erase(handle); }
+void free(uint64_t handle) {
+  std::unique_lock<std::shared_mutex> lock(mmap_mutex);
+  mmap.erase(handle);
+  mmap_generation.fetch_add(1, std::memory_order_relaxed);
+  device_allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t generation() noexcept {
+  return mmap_generation.load(std::memory_order_relaxed);
+}
+
+uint64_t allocations() noexcept {
+  return device_allocations.load(std::memory_order_relaxed);
+}
 
 }  // namespace weft::memory
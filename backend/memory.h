@@ -3,8 +3,10 @@
 
 #include <cuda.h>
 
+#include <atomic>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <unordered_map>
 
 namespace weft::memory {
@@ -16,8 +18,10 @@ class Block {
         size_{size},
         data_{std::make_unique<unsigned char[]>(size)} {}
   ~Block() {
-    for (auto& dptr : device_ptrs_) {
-      cuMemFree(dptr.second);
+    if (pinned_) cuMemHostUnregister(data_.get());
+    for (auto& copy : device_copies_) {
+      cuMemFree(copy.second.ptr);
+      if (copy.second.partial) cuMemFree(copy.second.partial);
     }
   }
 
@@ -29,15 +33,66 @@ class Block {
   void* data() const noexcept { return data_.get(); }
 
   CUdeviceptr* device_ptr(CUdevice device);
+
+  // Whether the device has memory for the Block, and a copy of the current
+  // host data in it
+  bool allocated(CUdevice device);
+  bool current(CUdevice device);
+
+  // Copies the data to the device unless its copy is already current.
+  // Returns whether it copied.
+  bool upload(CUdevice device, CUstream stream);
   void write_back(const CUdevice& device, const CUstream& stream);
 
+  // Page-locks the host data so range copies can overlap other work
+  void pin();
+  // Copies a byte range of the data to or from the device
+  void upload(CUdevice device, CUstream stream, size_t offset, size_t bytes);
+  void download(CUdevice device, CUstream stream, size_t offset,
+                size_t bytes);
+  // Ends range copies once they completed. The device copy is current if
+  // they covered the `whole` Block, and stale if only part was downloaded.
+  void copied(CUdevice device, bool downloaded, bool whole);
+
+  // Private memory on the device that a part of a split launch accumulates
+  // into, see combine.h
+  CUdeviceptr* partial_ptr(CUdevice device);
+  // Merges what the device accumulated into the host data
+  void combine(CUdevice device, CUstream stream,
+               void (*merge)(void* into, const void* partial, size_t bytes));
+
+  // Marks device copies stale after the host data changed
+  void modified() noexcept { version_.fetch_add(1, std::memory_order_relaxed); }
+
+  // SHA-256 of the host data, only rehashed after it was modified
+  std::string hash();
+
   unsigned char& operator[](size_t i) { return data_.get()[i]; }
 
  private:
   uint64_t handle_;
   size_t size_;
   std::unique_ptr<unsigned char[]> data_;
-  std::unordered_map<CUdevice, CUdeviceptr> device_ptrs_;
+  std::atomic<uint64_t> version_{1};  // of data_
+
+  std::mutex hash_mutex_;
+  uint64_t hash_version_ = 0;  // of data_ that hash_ is for
+  std::string hash_;
+
+  struct DeviceCopy {
+    CUdeviceptr ptr = 0;
+    uint64_t version = 0;  // of data_ it holds, 0 if none or written to
+    std::unique_ptr<unsigned char[]> staging;  // write_back buffer
+    CUdeviceptr partial = 0;
+  };
+  std::mutex device_copies_mutex_;
+  std::unordered_map<CUdevice, DeviceCopy> device_copies_;
+
+  DeviceCopy& device_copy(CUdevice device);
+
+  std::mutex combine_mutex_;  // parts of a launch merge concurrently
+  std::once_flag pin_once_;
+  bool pinned_ = false;
 
   std::unique_ptr<unsigned char[]> orig_data_;
   std::once_flag orig_data_init_;
@@ -47,6 +102,13 @@ uint64_t malloc(size_t size);
 void free(uint64_t handle);
 Block& get_block(uint64_t handle);
 
+// Bumped by every free, so cached Block pointers can detect invalidation
+uint64_t generation() noexcept;
+
+// Bumped by every allocation of device memory for a Block and every free, so
+// cached free device memory can detect it is stale
+uint64_t allocations() noexcept;
+
 }  // namespace weft::memory
 
 #endif  // WEFT_BACKEND_MEMORY_H
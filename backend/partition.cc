@@ -0,0 +1,69 @@
+#include "partition.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+namespace weft::partition {
+
+size_t longest_axis(const std::array<uint32_t, 3> &grid, unsigned axes) {
+  size_t axis = grid.size();
+  for (size_t i = 0; i < grid.size(); ++i) {
+    if ((axes >> i & 1) && grid[i] > 1 &&
+        (axis == grid.size() || grid[i] > grid[axis])) {
+      axis = i;
+    }
+  }
+  return axis;
+}
+
+std::vector<Slice> split(const std::array<uint32_t, 3> &grid, unsigned axes,
+                         const std::vector<double> &weights) {
+  auto axis = longest_axis(grid, axes);
+  if (axis == grid.size() || weights.size() < 2) {
+    return {Slice{0, {0, 0, 0}, grid}};
+  }
+
+  auto total = std::accumulate(weights.begin(), weights.end(), 0.0);
+  auto share = [&](size_t device) {
+    return total > 0 ? weights[device] / total : 1.0 / weights.size();
+  };
+
+  // Largest remainder apportionment of the axis
+  std::vector<uint32_t> blocks(weights.size());
+  std::vector<double> remainders(weights.size());
+  uint32_t assigned = 0;
+  for (size_t i = 0; i < weights.size(); ++i) {
+    auto exact = grid[axis] * share(i);
+    blocks[i] = static_cast<uint32_t>(std::floor(exact));
+    remainders[i] = exact - blocks[i];
+    assigned += blocks[i];
+  }
+  std::vector<size_t> order(weights.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return remainders[a] > remainders[b];
+  });
+  for (size_t i = 0; assigned < grid[axis]; i = (i + 1) % order.size()) {
+    ++blocks[order[i]];
+    ++assigned;
+  }
+
+  std::vector<Slice> slices;
+  uint32_t offset = 0;
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    if (!blocks[i]) continue;
+    Slice slice{i, {0, 0, 0}, grid};
+    slice.offset[axis] = offset;
+    slice.dim[axis] = blocks[i];
+    offset += blocks[i];
+    slices.push_back(slice);
+  }
+  return slices;
+}
+
+}  // namespace weft::partition
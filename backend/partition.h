@@ -0,0 +1,31 @@
+#ifndef WEFT_BACKEND_PARTITION_H
+#define WEFT_BACKEND_PARTITION_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace weft::partition {
+
+struct Slice {
+  size_t device;
+  std::array<uint32_t, 3> offset;  // in blocks, by axis
+  std::array<uint32_t, 3> dim;
+};
+
+// Longest of the allowed axes (a ptx::axis_* mask) with more than one block,
+// grid.size() if there is none
+size_t longest_axis(const std::array<uint32_t, 3> &grid, unsigned axes);
+
+// Splits a grid between devices along the longest of the allowed axes (a
+// ptx::axis_* mask), giving each a share of it in proportion to its weight.
+// Blocks left over by rounding go to the devices with the largest
+// remainders, so every block runs exactly once; devices whose share is empty
+// get no slice. With no axis to split along, device 0 runs the whole grid.
+std::vector<Slice> split(const std::array<uint32_t, 3> &grid, unsigned axes,
+                         const std::vector<double> &weights);
+
+}  // namespace weft::partition
+
+#endif  // WEFT_BACKEND_PARTITION_H
@@ -0,0 +1,51 @@
+#include "pipeline.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace weft::pipeline {
+
+unsigned waves() {
+  static const unsigned waves = [] {
+    const char* value = std::getenv("WEFT_PIPELINE");
+    unsigned waves = value ? std::strtoul(value, nullptr, 10) : 0;
+    if (waves < 2) return 0u;
+    std::clog << "> Pipeline: elementwise launches run in " << waves
+              << " waves\n";
+    return waves;
+  }();
+  return waves;
+}
+
+size_t element_size(size_t bytes, size_t pointee_size, uint64_t threads,
+                    uint32_t block_dim) {
+  auto fits = [&](size_t size) {
+    if (bytes % size) return false;
+    auto elements = bytes / size;
+    return elements <= threads && elements + block_dim > threads;
+  };
+  if (pointee_size) return fits(pointee_size) ? pointee_size : 0;
+  for (size_t size : {1, 2, 4, 8, 16}) {
+    if (fits(size)) return size;
+  }
+  return 0;
+}
+
+std::vector<std::pair<uint32_t, uint32_t>> cut(uint32_t offset,
+                                               uint32_t blocks,
+                                               unsigned waves) {
+  waves = std::max(1u, std::min(waves, blocks));
+  std::vector<std::pair<uint32_t, uint32_t>> result;
+  for (unsigned i = 0; i < waves; ++i) {
+    uint32_t begin = uint64_t{blocks} * i / waves;
+    uint32_t end = uint64_t{blocks} * (i + 1) / waves;
+    result.emplace_back(offset + begin, end - begin);
+  }
+  return result;
+}
+
+}  // namespace weft::pipeline
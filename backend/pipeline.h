@@ -0,0 +1,36 @@
+#ifndef WEFT_BACKEND_PIPELINE_H
+#define WEFT_BACKEND_PIPELINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Opt-in streaming of elementwise launches: the grid runs as waves of blocks
+// on rotating streams, each uploading its part of the buffers, running and
+// downloading its part of the results, so copies in both directions overlap
+// the kernel. Enabled by WEFT_PIPELINE=<waves>, for buffers the client
+// declared elementwise, see weft/pipeline.h.
+namespace weft::pipeline {
+
+// Waves per launch, 0 if off
+unsigned waves();
+
+// Most streams the waves of a launch rotate over
+constexpr size_t streams = 3;
+
+// Bytes per element of an elementwise buffer of a 1-D launch of `threads`
+// threads, in blocks of `block_dim`: the number of elements is within one
+// block of the threads. The pointee size is checked if known, else inferred.
+// 0 if the buffer does not fit.
+size_t element_size(size_t bytes, size_t pointee_size, uint64_t threads,
+                    uint32_t block_dim);
+
+// Offset and size of each wave of a range of blocks, as even as possible
+std::vector<std::pair<uint32_t, uint32_t>> cut(uint32_t offset,
+                                               uint32_t blocks,
+                                               unsigned waves);
+
+}  // namespace weft::pipeline
+
+#endif  // WEFT_BACKEND_PIPELINE_H
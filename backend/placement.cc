@@ -0,0 +1,32 @@
+#include "placement.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <tuple>
+#include <vector>
+
+namespace weft::placement {
+
+std::vector<size_t> rank(std::vector<Candidate> candidates,
+                         size_t launch_bytes) {
+  auto key = [&](const Candidate &candidate) {
+    bool fits = candidate.unallocated <= candidate.free;
+    return std::make_tuple(!fits,
+                           candidate.missing + candidate.queued * launch_bytes,
+                           ~candidate.free);
+  };
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [&](const Candidate &a, const Candidate &b) {
+                     return key(a) < key(b);
+                   });
+
+  std::vector<size_t> devices;
+  devices.reserve(candidates.size());
+  for (const auto &candidate : candidates) {
+    if (!devices.empty() && candidate.unallocated > candidate.free) break;
+    devices.push_back(candidate.device);
+  }
+  return devices;
+}
+
+}  // namespace weft::placement
@@ -0,0 +1,27 @@
+#ifndef WEFT_BACKEND_PLACEMENT_H
+#define WEFT_BACKEND_PLACEMENT_H
+
+#include <cstddef>
+#include <vector>
+
+namespace weft::placement {
+
+// What running a launch on a device would cost
+struct Candidate {
+  size_t device;
+  size_t missing;      // bytes of the launch's Blocks it would upload
+  size_t unallocated;  // bytes of them it has no memory for yet
+  size_t free;         // bytes of device memory
+  size_t queued;       // launch slices running or waiting on it
+};
+
+// Devices with room for a launch's Blocks, best first, or the best of all if
+// none has room. They are ranked by the bytes they would upload plus, for
+// each slice queued on them, the launch's bytes again, so a busy device only
+// wins if it holds the data. Ties go to the most free memory.
+std::vector<size_t> rank(std::vector<Candidate> candidates,
+                         size_t launch_bytes);
+
+}  // namespace weft::placement
+
+#endif  // WEFT_BACKEND_PLACEMENT_H
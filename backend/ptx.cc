@@ -0,0 +1,239 @@
+#include "ptx.h"
+
+#include <cctype>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace weft::ptx {
+
+namespace {
+
+struct Definition {
+  bool is_entry;
+  std::string name;
+  size_t line;          // start of the line declaring it
+  size_t name_end;      // just past the name
+  size_t params_close;  // of the parameter list, npos if there is none
+  size_t body_open;
+  size_t body_close;  // just past the closing brace
+};
+
+}  // namespace
+
+// Reads of whole %ctaid/%nctaid vectors or of clusters, which cannot be
+// adjusted in place
+constexpr unsigned unsupported = ~0u;
+
+static bool is_identifier(char c) {
+  return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$' ||
+         c == '%';
+}
+
+static size_t skip_space(std::string_view ptx, size_t pos) {
+  while (pos < ptx.size() &&
+         std::isspace(static_cast<unsigned char>(ptx[pos]))) {
+    ++pos;
+  }
+  return pos;
+}
+
+// Position just past the bracket matching the one at `open`
+static size_t skip_balanced(std::string_view ptx, size_t open) {
+  int depth = 0;
+  for (size_t i = open; i < ptx.size(); ++i) {
+    if (ptx[i] == '(' || ptx[i] == '{') ++depth;
+    if (ptx[i] == ')' || ptx[i] == '}') {
+      if (--depth == 0) return i + 1;
+    }
+  }
+  return std::string_view::npos;
+}
+
+static bool contains_word(std::string_view text, std::string_view word) {
+  for (auto pos = text.find(word); pos != std::string_view::npos;
+       pos = text.find(word, pos + 1)) {
+    auto end = pos + word.size();
+    if ((pos == 0 || !is_identifier(text[pos - 1])) &&
+        (end == text.size() || !is_identifier(text[end]))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Functions and kernels with a body, in order
+static std::vector<Definition> definitions(std::string_view ptx) {
+  std::vector<Definition> result;
+  for (auto pos = ptx.find('.'); pos != std::string_view::npos;
+       pos = ptx.find('.', pos + 1)) {
+    bool is_entry = ptx.compare(pos, 7, ".entry ") == 0 ||
+                    ptx.compare(pos, 7, ".entry\t") == 0;
+    bool is_func = ptx.compare(pos, 6, ".func ") == 0 ||
+                   ptx.compare(pos, 6, ".func\t") == 0;
+    if (!is_entry && !is_func) continue;
+
+    auto cursor = skip_space(ptx, pos + (is_entry ? 6 : 5));
+    if (is_func && cursor < ptx.size() && ptx[cursor] == '(') {
+      cursor = skip_space(ptx, skip_balanced(ptx, cursor));  // return value
+    }
+    auto name_begin = cursor;
+    while (cursor < ptx.size() && is_identifier(ptx[cursor])) ++cursor;
+    if (cursor == name_begin) continue;
+
+    Definition definition{
+        is_entry, std::string(ptx.substr(name_begin, cursor - name_begin)),
+        ptx.rfind('\n', pos) + 1, cursor, std::string_view::npos, 0, 0};
+    cursor = skip_space(ptx, cursor);
+    if (cursor < ptx.size() && ptx[cursor] == '(') {
+      cursor = skip_balanced(ptx, cursor);
+      if (cursor == std::string_view::npos) break;
+      definition.params_close = cursor - 1;
+    }
+
+    // Performance directives may sit between the signature and the body
+    auto body = ptx.find_first_of("{;", cursor);
+    if (body == std::string_view::npos) break;
+    if (ptx[body] == ';') continue;  // declaration only
+    definition.body_open = body;
+    definition.body_close = skip_balanced(ptx, body);
+    if (definition.body_close == std::string_view::npos) break;
+
+    pos = definition.body_close - 1;
+    result.push_back(std::move(definition));
+  }
+  return result;
+}
+
+// Axes whose component of %ctaid/%nctaid the body reads, or unsupported
+static unsigned reads(std::string_view body) {
+  unsigned result = 0;
+  for (std::string_view reg : {"%ctaid", "%nctaid"}) {
+    for (auto pos = body.find(reg); pos != std::string_view::npos;
+         pos = body.find(reg, pos + 1)) {
+      auto end = pos + reg.size();
+      char component = end + 1 < body.size() && body[end] == '.'
+                           ? body[end + 1]
+                           : '\0';
+      if (component < 'x' || component > 'z') return unsupported;
+      result |= axis_x << (component - 'x');
+    }
+  }
+  if (body.find("%cluster") != std::string_view::npos) return unsupported;
+  return result;
+}
+
+static void replace_all(std::string &text, std::string_view from,
+                        std::string_view to) {
+  for (auto pos = text.find(from); pos != std::string::npos;
+       pos = text.find(from, pos + to.size())) {
+    text.replace(pos, from.size(), to);
+  }
+}
+
+std::string split_marker(const std::string &entry) {
+  return entry + "_weft_split";
+}
+
+Split split(const std::string &ptx) {
+  auto defs = definitions(ptx);
+
+  // Axes that functions (transitively) read %ctaid/%nctaid of
+  std::unordered_map<std::string, unsigned> tainted;
+  for (const auto &def : defs) {
+    if (def.is_entry) continue;
+    auto axes = reads(std::string_view(ptx).substr(
+        def.body_open, def.body_close - def.body_open));
+    if (axes) tainted[def.name] = axes;
+  }
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (const auto &def : defs) {
+      if (def.is_entry) continue;
+      std::string_view body = std::string_view(ptx).substr(
+          def.body_open, def.body_close - def.body_open);
+      auto it = tainted.find(def.name);
+      unsigned own = it == tainted.end() ? 0 : it->second, grown = own;
+      for (const auto &[name, axes] : tainted) {
+        if ((axes & ~grown) && contains_word(body, name)) grown |= axes;
+      }
+      if (grown != own) {
+        tainted[def.name] = grown;
+        changed = true;
+      }
+    }
+  }
+
+  Split result;
+  std::string out;
+  out.reserve(ptx.size() + 1024);
+  size_t copied = 0;
+  for (const auto &def : defs) {
+    if (!def.is_entry) continue;
+
+    std::string body = ptx.substr(def.body_open + 1,
+                                  def.body_close - def.body_open - 2);
+    unsigned blocked = 0;
+    for (const auto &[name, axes] : tainted) {
+      if (contains_word(body, name)) blocked |= axes;
+    }
+    unsigned axes = (axis_x | axis_y | axis_z) & ~blocked;
+    if (!axes || reads(body) == unsupported) {
+      result.skipped.push_back(def.name);
+      continue;
+    }
+
+    out.append(ptx, copied, def.line - copied);
+    out += ".visible .global .align 4 .u32 " + split_marker(def.name) +
+           " = " + std::to_string(axes) + ";\n\n";
+    out.append(ptx, def.line, def.name_end - def.line);
+    std::string hidden =
+        "\t.param .u32 _weft_blockOffsetX,\n"
+        "\t.param .u32 _weft_blockOffsetY,\n"
+        "\t.param .u32 _weft_blockOffsetZ,\n"
+        "\t.param .u32 _weft_gridDimX,\n"
+        "\t.param .u32 _weft_gridDimY,\n"
+        "\t.param .u32 _weft_gridDimZ\n";
+    if (def.params_close == std::string::npos) {
+      out += "(\n" + hidden + ")";
+      out.append(ptx, def.name_end, def.body_open - def.name_end);
+    } else {
+      std::string_view params(ptx.data() + def.name_end,
+                              def.params_close - def.name_end);
+      params = params.substr(0, params.find_last_not_of(" \t\r\n") + 1);
+      bool empty = params.find_first_not_of(" \t\r\n(") == std::string::npos;
+      out.append(params);
+      out += empty ? "\n" : ",\n";
+      out += hidden;
+      out.append(ptx, def.params_close, def.body_open - def.params_close);
+    }
+
+    out += "{\n";
+    for (char axis : {'x', 'y', 'z'}) {
+      std::string component(1, axis);
+      std::string upper(1, static_cast<char>(std::toupper(axis)));
+      std::string ctaid = "%_weft_ctaid_" + component;
+      std::string nctaid = "%_weft_nctaid_" + component;
+      replace_all(body, "%ctaid." + component, ctaid);
+      replace_all(body, "%nctaid." + component, nctaid);
+      out += "\t.reg .b32 " + ctaid + ";\n"
+             "\t.reg .b32 " + nctaid + ";\n"
+             "\tld.param.u32 " + ctaid + ", [_weft_blockOffset" + upper +
+             "];\n"
+             "\tmov.u32 " + nctaid + ", %ctaid." + component + ";\n"
+             "\tadd.u32 " + ctaid + ", " + ctaid + ", " + nctaid + ";\n"
+             "\tld.param.u32 " + nctaid + ", [_weft_gridDim" + upper +
+             "];\n";
+    }
+    out += body;
+    out += '}';
+    copied = def.body_close;
+    result.entries.push_back(def.name);
+  }
+  out.append(ptx, copied, std::string::npos);
+  result.ptx = std::move(out);
+  return result;
+}
+
+}  // namespace weft::ptx
@@ -0,0 +1,35 @@
+#ifndef WEFT_BACKEND_PTX_H
+#define WEFT_BACKEND_PTX_H
+
+#include <string>
+#include <vector>
+
+namespace weft::ptx {
+
+struct Split {
+  std::string ptx;
+  std::vector<std::string> entries;  // rewritten
+  std::vector<std::string> skipped;
+};
+
+// Axes of a grid, as bits of a mask
+constexpr unsigned axis_x = 1, axis_y = 2, axis_z = 4;
+
+// Rewrites each .entry so a launch of part of the grid behaves like the same
+// blocks of the full launch. Six .u32 parameters are appended,
+// _weft_blockOffset{X,Y,Z} and _weft_gridDim{X,Y,Z}, and reads of
+// %ctaid.{x,y,z} and %nctaid.{x,y,z} become the offset block index and the
+// full grid size. A .func reading %ctaid or %nctaid cannot be adjusted in
+// place, so entries calling one cannot be split along the axes it reads.
+// Entries are skipped if that leaves no axis, or if they use clusters or read
+// the whole %ctaid vector.
+Split split(const std::string &ptx);
+
+// Global defined next to each rewritten entry, holding the mask of axes it
+// can be split along, so loaded modules (including cached ones) can tell
+// which kernels take the extra parameters
+std::string split_marker(const std::string &entry);
+
+}  // namespace weft::ptx
+
+#endif  // WEFT_BACKEND_PTX_H
@@ -2,19 +2,51 @@
 
 #include <cuda.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <future>
 #include <iostream>
-#include <thread>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "CUDA_samples/helper_cuda_drvapi.h"
+#include "client_event.h"
+#include "client_stream.h"
+#include "cost.h"
+#include "dataflow.h"
+#include "graph.h"
+#include "memo.h"
+#include "memory.h"
+#include "partition.h"
+#include "pipeline.h"
+#include "placement.h"
+#include "ptx.h"
+#include "steal.h"
 
 namespace weft {
 
+// Waits for every task before rethrowing the first failure, as the others
+// still use the launch's arguments and the caller's locals
+static void wait_all(std::vector<std::future<void>> &tasks) {
+  for (auto &task : tasks) task.wait();
+  for (auto &task : tasks) task.get();
+}
+
 Scheduler::Scheduler() : device_count_{CuInitialize()} {
   devices_.reserve(device_count_);
   for (int i = 0; i < device_count_; i++) {
     devices_.emplace_back(i);
+    throughputs_.push_back(devices_.back().throughput());
   }
+  queued_.resize(device_count_);
 }
 
 int Scheduler::CuInitialize() {
@@ -47,21 +79,522 @@ int Scheduler::CuInitialize() {
 }
 
 void Scheduler::schedule(const kernel::Function &func,
-                         const kernel::ExecutionArgs &execution) {
-  std::vector<std::thread> threads;
-  threads.reserve(device_count_);
+                         std::shared_ptr<const KernelLaunch> request,
+                         const std::string &client) {
+  if (devices_.empty()) return;
+  if (!graph::enabled()) {
+    enqueue(func, std::move(request), client);
+    return;
+  }
 
-  for (int i = 0; i < device_count_; i++) {
+  auto mutex = sequence_mutex(client);
+  std::lock_guard<std::mutex> ordered(*mutex);
+  graph::Detector::Verdict verdict;
+  std::shared_ptr<graph::Graphs> graphs;
+  {
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    auto &state = clients_[client];
+    auto length = state.sequence.length();
+    verdict = state.sequence.observe({&func, std::move(request)});
+    if (state.sequence.length() != length) {
+      // The graphs of a sequence that diverged go once its replays ran
+      state.graphs.reset();
+      if (state.sequence.length()) {
+        std::clog << "> Graph: " << client << " repeats a sequence of "
+                  << state.sequence.length() << " launches\n";
+        state.graphs = std::make_shared<graph::Graphs>();
+      }
+    }
+    graphs = state.graphs;
+  }
+  for (auto &launch : verdict.flush) {
+    enqueue(*launch.func, std::move(launch.request), client);
+  }
+  if (!verdict.batch.empty()) {
+    replay(std::move(verdict.batch), std::move(graphs), client);
+  }
+}
+
+void Scheduler::enqueue(const kernel::Function &func,
+                        std::shared_ptr<const KernelLaunch> request,
+                        const std::string &client) {
+  auto &target = find_stream(client, request->hstream());
+  auto queued = std::chrono::steady_clock::now();
+  auto done = std::make_shared<std::promise<void>>();
+  auto used = access(func, kernel::ExecutionArgs{*request});
+  auto after = [&] { return dataflow_.add(used, done->get_future().share()); };
+  target.dispatch(after, [this, &func, &target, request = std::move(request),
+                          client, queued, done] {
+    try {
+      launch(func, kernel::ExecutionArgs{*request}, target);
+    } catch (...) {
+      record_failure(client);
+    }
+    done->set_value();
+    record_latency(std::chrono::steady_clock::now() - queued);
+  });
+}
+
+void Scheduler::replay(std::vector<graph::Launch> batch,
+                       std::shared_ptr<graph::Graphs> graphs,
+                       const std::string &client) {
+  auto &target = find_stream(client, batch[0].request->hstream());
+  Dataflow::Access access;
+  for (const auto &launch : batch) {
+    auto used = this->access(*launch.func,
+                             kernel::ExecutionArgs{*launch.request});
+    access.reads.insert(access.reads.end(), used.reads.begin(),
+                        used.reads.end());
+    access.writes.insert(access.writes.end(), used.writes.begin(),
+                         used.writes.end());
+  }
+
+  auto queued = std::chrono::steady_clock::now();
+  auto done = std::make_shared<std::promise<void>>();
+  auto after = [&] {
+    return dataflow_.add(access, done->get_future().share());
+  };
+  target.dispatch(after, [this, &target, batch = std::move(batch),
+                          graphs = std::move(graphs), client, queued, done] {
+    try {
+      // The whole sequence runs where its first launch would
+      const auto &first = batch[0];
+      auto device =
+          place(*first.func, kernel::ExecutionArgs{*first.request}, 0)[0];
+      queue(device, 1);
+      target
+          .submit(device,
+                  [&](CUstream s) {
+                    Dequeue dequeue{this, device};
+                    graphs->run(devices_[device], batch, s);
+                  })
+          .get();
+    } catch (...) {
+      record_failure(client);
+    }
+    done->set_value();
+    auto latency = std::chrono::steady_clock::now() - queued;
+    for (size_t i = 0; i < batch.size(); ++i) record_latency(latency);
+  });
+}
+
+void Scheduler::release(const std::string &client) {
+  if (!graph::enabled()) return;
+  auto mutex = sequence_mutex(client);
+  std::lock_guard<std::mutex> ordered(*mutex);
+  std::vector<graph::Launch> held;
+  {
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    held = clients_[client].sequence.release();
+  }
+  for (auto &launch : held) {
+    enqueue(*launch.func, std::move(launch.request), client);
+  }
+}
+
+std::shared_ptr<std::mutex> Scheduler::sequence_mutex(
+    const std::string &client) {
+  std::lock_guard<std::mutex> lock(clients_mutex_);
+  return clients_[client].sequence_mutex;
+}
+
+void Scheduler::record_failure(const std::string &client) {
+  std::lock_guard<std::mutex> lock(clients_mutex_);
+  auto &failure = clients_[client].failure;
+  if (!failure) failure = std::current_exception();
+}
+
+// Const pointees are read and the others written. Unknown access counts as
+// a write, which orders the launch after every earlier use of the Block.
+Dataflow::Access Scheduler::access(const kernel::Function &func,
+                                   const kernel::ExecutionArgs &execution) {
+  Dataflow::Access access;
+  const auto &params = func.params();
+  auto count =
+      std::min(params.size(), static_cast<size_t>(execution.args.size()));
+  for (size_t i = 0; i < count; ++i) {
+    const auto &param = params[i];
+    if (!param.is_pointer || param.access == FunctionMetadata::Param::UNUSED) {
+      continue;
+    }
+    const auto &data = execution.args[i].data();
+    uint64_t block = 0;
+    std::memcpy(&block, data.data(), std::min(sizeof(block), data.size()));
+    if (param.is_const || param.access == FunctionMetadata::Param::READ_ONLY) {
+      access.reads.push_back(block);
+    } else {
+      access.writes.push_back(block);
+    }
+  }
+  return access;
+}
+
+void Scheduler::await_block(const std::string &client, uint64_t block,
+                            bool write) {
+  release(client);
+  Dataflow::Access access;
+  (write ? access.writes : access.reads).push_back(block);
+  for (const auto &work : dataflow_.hazards(access)) work.wait();
+  rethrow_failure(client);
+}
+
+void Scheduler::forget_block(uint64_t block) { dataflow_.erase(block); }
+
+ClientStream &Scheduler::stream(const std::string &client, uint64_t handle) {
+  release(client);
+  return find_stream(client, handle);
+}
+
+ClientStream &Scheduler::find_stream(const std::string &client,
+                                     uint64_t handle) {
+  {
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    auto &streams = clients_[client].streams;
+    auto it = streams.find(handle);
+    if (it != streams.end()) return *it->second;
+    if (handle != 0) {
+      throw std::out_of_range("unknown stream " + std::to_string(handle));
+    }
+  }
+  // Without holding the lock, as creating it starts threads; another call
+  // may have created it meanwhile
+  auto created = std::make_unique<ClientStream>(devices_);
+  std::lock_guard<std::mutex> lock(clients_mutex_);
+  return *clients_[client].streams.try_emplace(0, std::move(created))
+              .first->second;
+}
+
+uint64_t Scheduler::create_stream(const std::string &client) {
+  auto created = std::make_unique<ClientStream>(devices_);
+  std::lock_guard<std::mutex> lock(clients_mutex_);
+  auto &state = clients_[client];
+  auto handle = state.next_stream++;
+  state.streams.emplace(handle, std::move(created));
+  return handle;
+}
+
+void Scheduler::destroy_stream(const std::string &client, uint64_t stream) {
+  release(client);
+  std::unique_ptr<ClientStream> destroyed;
+  {
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    auto &streams = clients_[client].streams;
+    auto it = streams.find(stream);
+    if (it == streams.end()) {
+      throw std::out_of_range("unknown stream " + std::to_string(stream));
+    }
+    destroyed = std::move(it->second);
+    streams.erase(it);
+  }
+  // Waits for its launches here, without holding the lock
+}
+
+uint64_t Scheduler::create_event(const std::string &client) {
+  auto created = std::make_unique<ClientEvent>(devices_);
+  std::lock_guard<std::mutex> lock(clients_mutex_);
+  auto &state = clients_[client];
+  auto handle = state.next_event++;
+  state.events.emplace(handle, std::move(created));
+  return handle;
+}
+
+void Scheduler::destroy_event(const std::string &client, uint64_t event) {
+  release(client);
+  std::unique_ptr<ClientEvent> destroyed;
+  {
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    auto &events = clients_[client].events;
+    auto it = events.find(event);
+    if (it == events.end()) {
+      throw std::out_of_range("unknown event " + std::to_string(event));
+    }
+    destroyed = std::move(it->second);
+    events.erase(it);
+  }
+}
+
+ClientEvent &Scheduler::event(const std::string &client, uint64_t handle) {
+  release(client);
+  std::lock_guard<std::mutex> lock(clients_mutex_);
+  auto &events = clients_[client].events;
+  auto it = events.find(handle);
+  if (it == events.end()) {
+    throw std::out_of_range("unknown event " + std::to_string(handle));
+  }
+  return *it->second;
+}
+
+void Scheduler::drop_client(const std::string &client) {
+  Client dropped;
+  {
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    auto it = clients_.find(client);
+    if (it == clients_.end()) return;
+    dropped = std::move(it->second);
+    clients_.erase(it);
+  }
+  // Held launches are not run for a client that cannot see them
+  dropped.sequence.release();
+  std::clog << "> Scheduler: " << client << " left with "
+            << dropped.streams.size() << " streams and "
+            << dropped.events.size() << " events\n";
+  // Streams wait for their queued work here, without holding the lock, and
+  // the graphs go with the last replay
+  dropped.streams.clear();
+  dropped.graphs.reset();
+  // Queued work may have recorded a failure for it again
+  std::lock_guard<std::mutex> lock(clients_mutex_);
+  clients_.erase(client);
+}
+
+void Scheduler::synchronize(const std::string &client) {
+  release(client);
+  std::vector<ClientStream *> streams;
+  {
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    for (auto &stream : clients_[client].streams) {
+      streams.push_back(stream.second.get());
+    }
+  }
+  for (auto *stream : streams) stream->synchronize();
+  rethrow_failure(client);
+}
+
+void Scheduler::synchronize(const std::string &client, uint64_t handle) {
+  stream(client, handle).synchronize();
+  rethrow_failure(client);
+}
+
+void Scheduler::rethrow_failure(const std::string &client) {
+  std::exception_ptr failure;
+  {
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    std::swap(failure, clients_[client].failure);
+  }
+  if (failure) std::rethrow_exception(failure);
+}
+
+void Scheduler::launch(const kernel::Function &func,
+                       const kernel::ExecutionArgs &execution,
+                       ClientStream &stream) {
+  std::optional<std::string> memo_key;
+  if (memo::enabled()) {
+    memo_key = memo::key(func, execution);
+    if (memo_key && memo::replay(*memo_key, func, execution)) return;
+  }
+
+  unsigned axes = 0;
+  if ((device_count_ > 1 || pipeline::waves()) &&
+      (execution.gridDimX > 1 || execution.gridDimY > 1 ||
+       execution.gridDimZ > 1)) {
+    axes = func.split_axes(devices_);
+  }
+  auto placed = place(func, execution, axes);
+  auto axis = partition::longest_axis(execution.fullGridDim, axes);
+  if (steal::enabled() && placed.size() > 1 &&
+      axis != execution.fullGridDim.size()) {
+    launch_stealing(func, execution, stream, axis, placed);
+    if (memo_key) memo::record(*memo_key, func, execution);
+    return;
+  }
+
+  std::vector<partition::Slice> slices;
+  if (placed.size() == 1) {
+    slices.push_back({placed[0], {0, 0, 0}, execution.fullGridDim});
+  } else {
+    std::vector<double> weights(devices_.size());
+    for (auto i : placed) weights[i] = throughputs_[i];
+    slices = partition::split(execution.fullGridDim, axes, weights);
+  }
+
+  std::vector<std::future<void>> launched;
+  launched.reserve(slices.size());
+  auto waves = axes & ptx::axis_x ? pipeline::waves() : 0;
+
+  for (const auto &slice : slices) {
     auto execution_slice = execution;
-    execution_slice.gridDimX = execution.gridDimX / device_count_;
-    execution_slice.blockOffset = execution.gridDimX / device_count_ * i;
-    threads.emplace_back(&kernel::Function::execute, func,
-                         std::ref(devices_[i]), execution_slice);
+    execution_slice.gridDimX = slice.dim[0];
+    execution_slice.gridDimY = slice.dim[1];
+    execution_slice.gridDimZ = slice.dim[2];
+    execution_slice.blockOffset = slice.offset;
+    auto &device = devices_[slice.device];
+    queue(slice.device, 1);
+    launched.push_back(stream.submit(
+        slice.device, [this, &func, &device, index = slice.device,
+                       execution_slice, waves](CUstream s) {
+          Dequeue dequeue{this, index};
+          if (waves && func.execute_pipelined(device, execution_slice, s,
+                                              waves)) {
+            return;
+          }
+          kernel::Timing timing;
+          func.execute(device, execution_slice, s, &timing);
+          cost::record(func, execution_slice, timing);
+        }));
+  }
+
+  wait_all(launched);
+
+  if (memo_key) memo::record(*memo_key, func, execution);
+}
+
+std::vector<size_t> Scheduler::place(const kernel::Function &func,
+                                     const kernel::ExecutionArgs &execution,
+                                     unsigned axes) {
+  // Until the cost model has seen the kernel: blocks per SM of the best
+  // device that a grid needs before spreading it over another device gains
+  // more compute than its uploads cost
+  constexpr uint64_t spread_blocks = 16;
+
+  auto access = this->access(func, execution);
+  std::vector<memory::Block *> blocks;
+  size_t launch_bytes = 0, written_bytes = 0;
+  for (const auto *handles : {&access.reads, &access.writes}) {
+    for (auto handle : *handles) {
+      auto &block = memory::get_block(handle);
+      if (handles == &access.writes) written_bytes += block.size();
+      if (std::find(blocks.begin(), blocks.end(), &block) != blocks.end()) {
+        continue;
+      }
+      blocks.push_back(&block);
+      launch_bytes += block.size();
+    }
+  }
+
+  auto free = free_memory();
+  std::vector<placement::Candidate> candidates;
+  candidates.reserve(devices_.size());
+  for (size_t i = 0; i < devices_.size(); ++i) {
+    placement::Candidate candidate{i, 0, 0, free[i], 0};
+    for (auto *block : blocks) {
+      if (!block->current(devices_[i])) candidate.missing += block->size();
+      if (!block->allocated(devices_[i])) {
+        candidate.unallocated += block->size();
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(queued_mutex_);
+      candidate.queued = queued_[i];
+    }
+    candidates.push_back(candidate);
+  }
+  auto ranked = placement::rank(candidates, launch_bytes);
+
+  size_t count = 1;
+  if (axes && ranked.size() > 1) {
+    std::vector<cost::Transfers> transfers;
+    for (auto i : ranked) {
+      transfers.push_back({throughputs_[i], candidates[i].missing});
+    }
+    if (auto predicted = cost::devices(func, execution, transfers,
+                                       written_bytes)) {
+      count = *predicted;
+    } else {
+      uint64_t grid = uint64_t{execution.gridDimX} * execution.gridDimY *
+                      execution.gridDimZ;
+      auto per_device =
+          spread_blocks * devices_[ranked[0]].multiprocessor_count();
+      count = std::max<uint64_t>(1, grid / std::max<uint64_t>(1, per_device));
+    }
   }
+  ranked.resize(std::min(count, ranked.size()));
+
+  std::clog << "> Place: " << func.name() << " on Device";
+  for (auto i : ranked) std::clog << " " << devices_[i];
+  std::clog << " of " << launch_bytes << " bytes\n";
+  return ranked;
+}
 
-  for (auto &t : threads) {
-    t.join();
+std::vector<size_t> Scheduler::free_memory() {
+  // Read first, so an allocation during the queries refreshes again
+  auto allocations = memory::allocations();
+  std::lock_guard<std::mutex> lock(free_memory_mutex_);
+  if (free_memory_allocations_ != allocations) {
+    free_memory_.clear();
+    for (const auto &device : devices_) {
+      free_memory_.push_back(device.free_memory());
+    }
+    free_memory_allocations_ = allocations;
   }
+  return free_memory_;
+}
+
+void Scheduler::queue(size_t device, int change) {
+  std::lock_guard<std::mutex> lock(queued_mutex_);
+  queued_[device] += change;
+}
+
+Scheduler::Dequeue::~Dequeue() { scheduler->queue(device, -1); }
+
+void Scheduler::launch_stealing(const kernel::Function &func,
+                                const kernel::ExecutionArgs &execution,
+                                ClientStream &stream, size_t axis,
+                                const std::vector<size_t> &devices) {
+  using clock = std::chrono::steady_clock;
+  std::vector<double> expected;
+  for (auto i : devices) expected.push_back(throughputs_[i]);
+  steal::BlockRanges ranges(execution.fullGridDim[axis], std::move(expected));
+  std::vector<clock::time_point> finished(devices.size(), clock::now());
+
+  std::vector<std::future<void>> launched;
+  launched.reserve(devices.size());
+  for (size_t i = 0; i < devices.size(); ++i) {
+    auto &device = devices_[devices[i]];
+    queue(devices[i], 1);
+    launched.push_back(stream.submit(devices[i], [&, i](CUstream s) {
+      Dequeue dequeue{this, devices[i]};
+      while (auto range = ranges.next(i)) {
+        auto slice = execution;
+        slice.blockOffset[axis] = range->first;
+        (axis == 0   ? slice.gridDimX
+         : axis == 1 ? slice.gridDimY
+                     : slice.gridDimZ) = range->second;
+
+        // Waits for the range, so the device only asks for the next one
+        // once it is free
+        auto start = clock::now();
+        kernel::Timing timing;
+        func.execute(device, slice, s, &timing);
+        finished[i] = clock::now();
+        cost::record(func, slice, timing);
+        ranges.finished(i, range->second, finished[i] - start);
+      }
+    }));
+  }
+  // The lanes use the ranges and finish times on this frame
+  wait_all(launched);
+
+  auto [first, last] = std::minmax_element(finished.begin(), finished.end());
+  std::clog << "> Steal: " << func.name() << " on";
+  auto taken = ranges.taken();
+  for (size_t i = 0; i < taken.size(); ++i) {
+    std::clog << " Device " << devices_[devices[i]] << ": " << taken[i].second
+              << " blocks in " << taken[i].first << " ranges;";
+  }
+  std::clog << " finished within "
+            << std::chrono::duration<double, std::milli>(*last - *first)
+                   .count()
+            << " ms of each other\n";
+}
+
+void Scheduler::record_latency(std::chrono::nanoseconds latency) {
+  // Launches per percentile report
+  constexpr size_t window = 1000;
+
+  std::lock_guard<std::mutex> lock(latency_mutex_);
+  latencies_.push_back(latency);
+  if (latencies_.size() < window) return;
+
+  auto percentile = [&](size_t p) {
+    auto nth = latencies_.begin() + latencies_.size() * p / 100;
+    std::nth_element(latencies_.begin(), nth, latencies_.end());
+    return std::chrono::duration<double, std::micro>(*nth).count();
+  };
+  auto p50 = percentile(50);
+  auto p99 = percentile(99);
+  std::clog << "> Scheduler: launch latency p50 " << p50 << " us, p99 " << p99
+            << " us over " << latencies_.size() << " launches\n";
+  latencies_.clear();
 }
 
 }  // namespace weft
@@ -1,10 +1,22 @@
 #ifndef WEFT_BACKEND_SCHEDULER_H
 #define WEFT_BACKEND_SCHEDULER_H
 
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "client_event.h"
+#include "client_stream.h"
+#include "dataflow.h"
 #include "device.h"
+#include "graph.h"
 #include "kernel.h"
+#include "weft.grpc.pb.h"
 
 namespace weft {
 
@@ -12,14 +24,135 @@ class Scheduler {
  public:
   Scheduler();
 
+  const std::vector<Device> &devices() const noexcept { return devices_; }
+
+  // Queues the launch on the client's stream (0 is its default stream) and
+  // returns. A launch starts once the work queued before it on the stream
+  // has finished, and the earlier launches of other streams using the same
+  // Blocks, where one of the two writes; other launches overlap. The
+  // percentiles of their latency from queueing to completion are logged.
+  // Throws std::out_of_range for unknown streams. With graphs enabled,
+  // iterations of a sequence the client repeats are held back until
+  // complete, see graph.h; every other call for the client first queues what
+  // is held.
   void schedule(const kernel::Function &func,
-                const kernel::ExecutionArgs &execution);
+                std::shared_ptr<const KernelLaunch> request,
+                const std::string &client);
+
+  // Handles start at first_stream, see Stream in weft.proto
+  uint64_t create_stream(const std::string &client);
+  // Waits for the launches queued on it
+  void destroy_stream(const std::string &client, uint64_t stream);
+
+  // Waits for the launches queued on all the client's streams or just one,
+  // then rethrows the first failure among its launches since it last
+  // synchronized
+  void synchronize(const std::string &client);
+  void synchronize(const std::string &client, uint64_t stream);
+
+  // Waits for the launches that a copy to (write) or from the Block must
+  // follow, then rethrows the client's first failure since it last
+  // synchronized
+  void await_block(const std::string &client, uint64_t block, bool write);
+  // After the Block was freed
+  void forget_block(uint64_t block);
+
+  // Creates the client's stream 0 on first use. Throws std::out_of_range for
+  // unknown handles.
+  ClientStream &stream(const std::string &client, uint64_t handle);
+
+  uint64_t create_event(const std::string &client);
+  // Waits for its queued records and waits
+  void destroy_event(const std::string &client, uint64_t event);
+  // Throws std::out_of_range for unknown handles
+  ClientEvent &event(const std::string &client, uint64_t handle);
+
+  // After the client went away: waits for its queued work, then releases its
+  // streams and events
+  void drop_client(const std::string &client);
 
  private:
+  // Above CU_STREAM_LEGACY and CU_STREAM_PER_THREAD
+  static constexpr uint64_t first_stream = 3;
+
+  struct Client {
+    std::unordered_map<uint64_t, std::unique_ptr<ClientStream>> streams;
+    uint64_t next_stream = first_stream;
+    // After the streams, as their queued records and waits use them
+    std::unordered_map<uint64_t, std::unique_ptr<ClientEvent>> events;
+    uint64_t next_event = 1;
+    std::exception_ptr failure;
+    // Held from taking launches out of the sequence until they are queued,
+    // so the client's threads cannot queue them out of order
+    std::shared_ptr<std::mutex> sequence_mutex = std::make_shared<std::mutex>();
+    graph::Detector sequence;
+    // Of the sequence, shared with its queued replays
+    std::shared_ptr<graph::Graphs> graphs;
+  };
+
   int device_count_;
   std::vector<Device> devices_;
+  std::vector<double> throughputs_;  // by device, to weight grid shares
+
+  Dataflow dataflow_;
+
+  std::mutex queued_mutex_;
+  std::vector<size_t> queued_;  // slices by device
+
+  // Free memory by device, queried again only once Blocks were allocated on
+  // or freed from the devices since, see memory::allocations()
+  std::mutex free_memory_mutex_;
+  std::optional<uint64_t> free_memory_allocations_;
+  std::vector<size_t> free_memory_;
+
+  std::mutex latency_mutex_;
+  std::vector<std::chrono::nanoseconds> latencies_;
+
+  // After the devices, as their streams use them
+  std::mutex clients_mutex_;
+  std::unordered_map<std::string, Client> clients_;
 
   int CuInitialize();
+  void enqueue(const kernel::Function &func,
+               std::shared_ptr<const KernelLaunch> request,
+               const std::string &client);
+  // Queues an iteration of a repeated sequence to run as one graph
+  void replay(std::vector<graph::Launch> batch,
+              std::shared_ptr<graph::Graphs> graphs,
+              const std::string &client);
+  // Queues the launches held back for the client
+  void release(const std::string &client);
+  std::shared_ptr<std::mutex> sequence_mutex(const std::string &client);
+  ClientStream &find_stream(const std::string &client, uint64_t handle);
+  // Keeps the client's first failure, from within a catch block
+  void record_failure(const std::string &client);
+  void rethrow_failure(const std::string &client);
+  static Dataflow::Access access(const kernel::Function &func,
+                                 const kernel::ExecutionArgs &execution);
+  // Devices to run the launch on, best first: those holding its Blocks and
+  // least busy, see placement.h. How many the grid spreads over is what the
+  // cost model predicts to finish soonest, see cost.h.
+  std::vector<size_t> place(const kernel::Function &func,
+                            const kernel::ExecutionArgs &execution,
+                            unsigned axes);
+  std::vector<size_t> free_memory();
+  // Counts the slices running or waiting on a device
+  void queue(size_t device, int change);
+  // Takes a slice off its device's count once it has run, even if it threw
+  struct Dequeue {
+    Scheduler *scheduler;
+    size_t device;
+    ~Dequeue();
+  };
+  void launch(const kernel::Function &func,
+              const kernel::ExecutionArgs &execution, ClientStream &stream);
+  // Runs the launch as block ranges along the axis that each of the devices
+  // takes from a shared queue until none are left, see steal.h
+  void launch_stealing(const kernel::Function &func,
+                       const kernel::ExecutionArgs &execution,
+                       ClientStream &stream, size_t axis,
+                       const std::vector<size_t> &devices);
+  void record_latency(std::chrono::nanoseconds latency);
 };
 
 }  // namespace weft
@@ -7,13 +7,21 @@
 #include <grpcpp/server_builder.h>
 #include <grpcpp/server_context.h>
 
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
 #include <string_view>
+#include <utility>
 
 #include "CUDA_samples/drvapi_error_string.h"
+#include "client_event.h"
 #include "device.h"
 #include "kernel.h"
 #include "memory.h"
 #include "weft.grpc.pb.h"
+#include "weft/hash.h"
 
 namespace weft {
 
@@ -26,6 +34,54 @@ using grpc::Status;
 
 constexpr size_t chunk_size = 64 * 1024;
 
+// Runs f, turning failed launches and unknown functions, streams or events
+// into a Status
+template <typename F>
+static Status status_of(F&& f) {
+  try {
+    f();
+  } catch (const EventNotReady& e) {
+    return Status(grpc::StatusCode::FAILED_PRECONDITION, e.what());
+  } catch (const std::out_of_range& e) {
+    std::cerr << "> Scheduler: " << e.what() << "\n";
+    return Status(grpc::StatusCode::INVALID_ARGUMENT, e.what());
+  } catch (const NoFreeStream& e) {
+    std::cerr << "> Scheduler: " << e.what() << "\n";
+    return Status(grpc::StatusCode::RESOURCE_EXHAUSTED, e.what());
+  } catch (const std::exception& e) {
+    std::cerr << "> Scheduler: " << e.what() << "\n";
+    return Status(grpc::StatusCode::INTERNAL, e.what());
+  }
+  return Status::OK;
+}
+
+grpc::ServerWriteReactor<Empty>* CudaDriverImpl::Session(
+    grpc::CallbackServerContext* context, const Empty* /*request*/) {
+  // Writes nothing and ends once the client cancels or disconnects
+  class Reactor : public grpc::ServerWriteReactor<Empty> {
+   public:
+    Reactor(CudaDriverImpl& service, std::string peer)
+        : service_{service}, peer_{std::move(peer)} {}
+
+    void OnCancel() override {
+      service_.leaving_.submit(
+          [&scheduler = service_.scheduler_, peer = peer_] {
+            scheduler.drop_client(peer);
+          });
+      Finish(Status::CANCELLED);
+    }
+    void OnDone() override { delete this; }
+
+   private:
+    CudaDriverImpl& service_;
+    std::string peer_;
+  };
+
+  auto peer = context->peer();
+  std::clog << "> Scheduler: " << peer << " connected\n";
+  return new Reactor(*this, std::move(peer));
+}
+
 Status CudaDriverImpl::MemAlloc(ServerContext* context, const Size* request,
                                 DevicePointer* response) {
   auto handle = memory::malloc(request->size());
@@ -39,7 +95,12 @@ Status CudaDriverImpl::MemFree(ServerContext* context,
                                const DevicePointer* request,
                                Empty* /*response*/) {
   auto handle = request->handle();
+  if (auto status = await_block(context, handle, true); !status.ok()) {
+    return status;
+  }
+
   memory::free(handle);
+  scheduler_.forget_block(handle);
   std::clog << "> VMM: MemFree " << handle << "\n";
   return Status::OK;
 }
@@ -51,7 +112,11 @@ Status CudaDriverImpl::MemcpyHtoD(ServerContext* context,
 
   // Initial read + get block
   request->Read(&chunk);
-  const auto& block = memory::get_block(chunk.dptr().handle());
+  if (auto status = await_block(context, chunk.dptr().handle(), true);
+      !status.ok()) {
+    return status;
+  }
+  auto& block = memory::get_block(chunk.dptr().handle());
 
   // Write chunks to block
   auto block_data_ptr = static_cast<char*>(block.data());
@@ -60,6 +125,7 @@ Status CudaDriverImpl::MemcpyHtoD(ServerContext* context,
     std::memcpy(block_data_ptr, data.data(), data.length());
     block_data_ptr += data.length();
   }
+  block.modified();
 
   std::clog << "> VMM: MemcpyHtoD " << block.handle() << "\n";
   return Status::OK;
@@ -68,6 +134,11 @@ Status CudaDriverImpl::MemcpyHtoD(ServerContext* context,
 Status CudaDriverImpl::MemcpyDtoH(ServerContext* context,
                                   const MemoryRead* request,
                                   ServerWriter<MemoryChunk>* response) {
+  if (auto status = await_block(context, request->dptr().handle(), false);
+      !status.ok()) {
+    return status;
+  }
+
   const auto& block = memory::get_block(request->dptr().handle());
 
   MemoryChunk chunk;
@@ -90,33 +161,152 @@ Status CudaDriverImpl::ModuleGetFunction(ServerContext* context,
   std::vector<kernel::Param> params;
   params.reserve(request->params_size());
   for (const auto& param : request->params()) {
-    params.emplace_back(param.size(), param.is_pointer(), param.is_const());
+    params.emplace_back(param.size(), param.is_pointer(), param.is_const(),
+                        param.access());
   }
 
-  // FIXME: move semantics for params
-  auto function = kernel::add_function(request->module().handle(),
-                                       request->function_name(), params);
+  const auto& function = kernel::add_function(
+      request->module().handle(), request->function_name(), std::move(params));
   std::clog << "> Kernel: ModuleGetFunction " << function.handle() << "\n";
   response->set_handle(function.handle());
   return Status::OK;
 }
 
 Status CudaDriverImpl::ModuleLoadData(ServerContext* context,
-                                      const PTX* request, Module* response) {
-  auto handle = kernel::add_ptx(request->str());
+                                      const Image* request,
+                                      Module* response) {
+  auto handle = kernel::add_image(*request);
+  kernel::get_module(handle).compile(scheduler_.devices());
   std::clog << "> Kernel: ModuleLoadData " << handle << "\n";
   response->set_handle(handle);
   return Status::OK;
 }
 
+Status CudaDriverImpl::ModuleLoadCached(ServerContext* context,
+                                        const ModuleHash* request,
+                                        Module* response) {
+  auto handle = kernel::add_cached_image(request->hash());
+  if (!handle) {
+    std::clog << "> Kernel: ModuleLoadCached miss " << to_hex(request->hash())
+              << "\n";
+    return Status(grpc::StatusCode::NOT_FOUND, "module not cached");
+  }
+  kernel::get_module(*handle).compile(scheduler_.devices());
+  std::clog << "> Kernel: ModuleLoadCached " << *handle << "\n";
+  response->set_handle(*handle);
+  return Status::OK;
+}
+
 Status CudaDriverImpl::LaunchKernel(ServerContext* context,
                                     const KernelLaunch* request,
                                     Empty* /*empty*/) {
-  auto func = kernel::get_function(request->f());
-  const kernel::ExecutionArgs execution{*request};
-  scheduler_.schedule(func, execution);
+  return status_of([&] {
+    const auto& func = kernel::get_function(request->f());
+    auto launch = std::make_shared<const KernelLaunch>(*request);
+    func.observe(kernel::ExecutionArgs{*launch});
+    scheduler_.schedule(func, std::move(launch), context->peer());
+  });
+}
 
-  return Status::OK;
+Status CudaDriverImpl::Synchronize(ServerContext* context,
+                                   const Empty* /*request*/,
+                                   Empty* /*response*/) {
+  return status_of([&] { scheduler_.synchronize(context->peer()); });
+}
+
+Status CudaDriverImpl::await_block(ServerContext* context, uint64_t block,
+                                   bool write) {
+  return status_of(
+      [&] { scheduler_.await_block(context->peer(), block, write); });
+}
+
+Status CudaDriverImpl::StreamCreate(ServerContext* context,
+                                    const Empty* /*request*/,
+                                    Stream* response) {
+  return status_of([&] {
+    response->set_handle(scheduler_.create_stream(context->peer()));
+    std::clog << "> Scheduler: StreamCreate " << response->handle() << "\n";
+  });
+}
+
+Status CudaDriverImpl::StreamDestroy(ServerContext* context,
+                                     const Stream* request,
+                                     Empty* /*response*/) {
+  std::clog << "> Scheduler: StreamDestroy " << request->handle() << "\n";
+  return status_of(
+      [&] { scheduler_.destroy_stream(context->peer(), request->handle()); });
+}
+
+Status CudaDriverImpl::StreamSynchronize(ServerContext* context,
+                                         const Stream* request,
+                                         Empty* /*response*/) {
+  return status_of(
+      [&] { scheduler_.synchronize(context->peer(), request->handle()); });
+}
+
+Status CudaDriverImpl::StreamWaitEvent(ServerContext* context,
+                                       const EventStream* request,
+                                       Empty* /*response*/) {
+  return status_of([&] {
+    const auto& peer = context->peer();
+    scheduler_.event(peer, request->event().handle())
+        .wait(scheduler_.stream(peer, request->stream().handle()));
+  });
+}
+
+Status CudaDriverImpl::EventRecord(ServerContext* context,
+                                   const EventStream* request,
+                                   Empty* /*response*/) {
+  return status_of([&] {
+    const auto& peer = context->peer();
+    scheduler_.event(peer, request->event().handle())
+        .record(scheduler_.stream(peer, request->stream().handle()));
+  });
+}
+
+Status CudaDriverImpl::EventCreate(ServerContext* context,
+                                   const Empty* /*request*/,
+                                   Event* response) {
+  return status_of([&] {
+    response->set_handle(scheduler_.create_event(context->peer()));
+    std::clog << "> Scheduler: EventCreate " << response->handle() << "\n";
+  });
+}
+
+Status CudaDriverImpl::EventDestroy(ServerContext* context,
+                                    const Event* request,
+                                    Empty* /*response*/) {
+  std::clog << "> Scheduler: EventDestroy " << request->handle() << "\n";
+  return status_of(
+      [&] { scheduler_.destroy_event(context->peer(), request->handle()); });
+}
+
+Status CudaDriverImpl::EventQuery(ServerContext* context, const Event* request,
+                                  Empty* /*response*/) {
+  return status_of([&] {
+    if (!scheduler_.event(context->peer(), request->handle()).query()) {
+      throw EventNotReady("event not ready");
+    }
+  });
+}
+
+Status CudaDriverImpl::EventSynchronize(ServerContext* context,
+                                        const Event* request,
+                                        Empty* /*response*/) {
+  return status_of([&] {
+    scheduler_.event(context->peer(), request->handle()).synchronize();
+  });
+}
+
+Status CudaDriverImpl::EventElapsedTime(ServerContext* context,
+                                        const EventPair* request,
+                                        ElapsedTime* response) {
+  return status_of([&] {
+    const auto& peer = context->peer();
+    auto& start = scheduler_.event(peer, request->start().handle());
+    response->set_milliseconds(
+        scheduler_.event(peer, request->end().handle()).elapsed_since(start));
+  });
 }
 
 }  // namespace weft
@@ -4,14 +4,22 @@
 #include <grpc/grpc.h>
 #include <grpcpp/server.h>
 #include <grpcpp/server_context.h>
+#include <grpcpp/support/server_callback.h>
 
 #include "scheduler.h"
 #include "weft.grpc.pb.h"
+#include "worker.h"
 
 namespace weft {
 
-class CudaDriverImpl final : public CudaDriver::Service {
+// Session is served by a callback, so a connected client holds no thread
+class CudaDriverImpl final
+    : public CudaDriver::WithCallbackMethod_Session<CudaDriver::Service> {
  public:
+  // Drops the client's scheduler state once it has gone away
+  grpc::ServerWriteReactor<Empty>* Session(grpc::CallbackServerContext* context,
+                                           const Empty* /*request*/) override;
+
   grpc::Status MemAlloc(grpc::ServerContext* context, const Size* request,
                         DevicePointer* response) override;
   grpc::Status MemFree(grpc::ServerContext* context,
@@ -27,15 +35,58 @@ class CudaDriverImpl final : public CudaDriver::Service {
   grpc::Status ModuleGetFunction(grpc::ServerContext* context,
                                  const FunctionMetadata* request,
                                  Function* response) override;
-  grpc::Status ModuleLoadData(grpc::ServerContext* context, const PTX* request,
-                              Module* response) override;
+  grpc::Status ModuleLoadData(grpc::ServerContext* context,
+                              const Image* request, Module* response) override;
+  grpc::Status ModuleLoadCached(grpc::ServerContext* context,
+                                const ModuleHash* request,
+                                Module* response) override;
 
   grpc::Status LaunchKernel(grpc::ServerContext* context,
                             const KernelLaunch* request,
                             Empty* /*response*/) override;
+  grpc::Status Synchronize(grpc::ServerContext* context,
+                           const Empty* /*request*/,
+                           Empty* /*response*/) override;
+
+  grpc::Status StreamCreate(grpc::ServerContext* context,
+                            const Empty* /*request*/,
+                            Stream* response) override;
+  grpc::Status StreamDestroy(grpc::ServerContext* context,
+                             const Stream* request,
+                             Empty* /*response*/) override;
+  grpc::Status StreamSynchronize(grpc::ServerContext* context,
+                                 const Stream* request,
+                                 Empty* /*response*/) override;
+  grpc::Status StreamWaitEvent(grpc::ServerContext* context,
+                               const EventStream* request,
+                               Empty* /*response*/) override;
+
+  grpc::Status EventRecord(grpc::ServerContext* context,
+                           const EventStream* request,
+                           Empty* /*response*/) override;
+  grpc::Status EventCreate(grpc::ServerContext* context,
+                           const Empty* /*request*/, Event* response) override;
+  grpc::Status EventDestroy(grpc::ServerContext* context, const Event* request,
+                            Empty* /*response*/) override;
+  grpc::Status EventQuery(grpc::ServerContext* context, const Event* request,
+                          Empty* /*response*/) override;
+  grpc::Status EventSynchronize(grpc::ServerContext* context,
+                                const Event* request,
+                                Empty* /*response*/) override;
+  grpc::Status EventElapsedTime(grpc::ServerContext* context,
+                                const EventPair* request,
+                                ElapsedTime* response) override;
 
  private:
   Scheduler scheduler_;
+  // Drops the clients that went away, off gRPC's callback threads, as that
+  // waits for their queued work. After the scheduler, so it stops first.
+  Worker leaving_;
+
+  // Waits for the launches a copy to (write) or from the Block must follow,
+  // with the first failure of the client's
+  grpc::Status await_block(grpc::ServerContext* context, uint64_t block,
+                           bool write);
 };
 
 }  // namespace weft
@@ -0,0 +1,89 @@
+#include "steal.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace weft::steal {
+
+bool enabled() {
+  static const bool enabled = [] {
+    const char* value = std::getenv("WEFT_STEAL");
+    bool enabled = value && *value && std::strcmp(value, "0") != 0;
+    if (enabled) std::clog << "> Steal: split launches are work-stealing\n";
+    return enabled;
+  }();
+  return enabled;
+}
+
+BlockRanges::BlockRanges(uint32_t blocks, std::vector<double> expected)
+    : blocks_{blocks} {
+  // Ranges per device at most, as each one uploads and writes back the
+  // kernel's Blocks in full
+  constexpr uint32_t max_ranges = 16;
+  auto devices = static_cast<uint32_t>(expected.size());
+  min_range_ = std::max<uint32_t>(1, blocks / (devices * max_ranges));
+
+  rates_.reserve(expected.size());
+  for (auto value : expected) rates_.push_back(Rate{value});
+}
+
+double BlockRanges::rate(size_t device) const {
+  // Devices that have not finished a range yet are assumed to keep the
+  // ratio of expected to measured rate of those that have
+  double measured = 0, expected = 0;
+  for (const auto& rate : rates_) {
+    if (rate.elapsed.count()) {
+      measured += rate.blocks / std::chrono::duration<double>(rate.elapsed)
+                                    .count();
+      expected += rate.expected;
+    }
+  }
+  const auto& rate = rates_[device];
+  if (rate.elapsed.count()) {
+    return rate.blocks / std::chrono::duration<double>(rate.elapsed).count();
+  }
+  return expected > 0 ? rate.expected * measured / expected : rate.expected;
+}
+
+std::optional<std::pair<uint32_t, uint32_t>> BlockRanges::next(
+    size_t device) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (next_ == blocks_) return std::nullopt;
+
+  double total = 0;
+  for (size_t i = 0; i < rates_.size(); ++i) total += rate(i);
+  double share = total > 0 ? rate(device) / total : 1.0 / rates_.size();
+
+  auto remaining = blocks_ - next_;
+  auto size = static_cast<uint32_t>(std::ceil(remaining * share / 2));
+  size = std::min(remaining, std::max(size, min_range_));
+
+  std::pair<uint32_t, uint32_t> range{next_, size};
+  next_ += size;
+  ++rates_[device].ranges;
+  return range;
+}
+
+void BlockRanges::finished(size_t device, uint32_t blocks,
+                           std::chrono::nanoseconds elapsed) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  rates_[device].blocks += blocks;
+  rates_[device].elapsed += elapsed;
+}
+
+std::vector<std::pair<size_t, uint64_t>> BlockRanges::taken() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<std::pair<size_t, uint64_t>> taken;
+  for (const auto& rate : rates_) taken.emplace_back(rate.ranges, rate.blocks);
+  return taken;
+}
+
+}  // namespace weft::steal
@@ -0,0 +1,58 @@
+#ifndef WEFT_BACKEND_STEAL_H
+#define WEFT_BACKEND_STEAL_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Opt-in execution of split launches as many block ranges that devices pull
+// from a shared queue, so a slow or busy device takes fewer of them instead
+// of holding up the launch. Enabled by WEFT_STEAL=1.
+namespace weft::steal {
+
+bool enabled();
+
+// Blocks along the split axis of one launch, handed out in ranges as devices
+// ask for them. A range is the asking device's share of what remains, by the
+// throughput the devices have shown so far (or their expected throughput
+// before they have run anything), halved so the last ranges are small and
+// devices finish together.
+class BlockRanges {
+ public:
+  BlockRanges(uint32_t blocks, std::vector<double> expected);
+
+  // Offset and size of the device's next range, nullopt once all are taken
+  std::optional<std::pair<uint32_t, uint32_t>> next(size_t device);
+
+  // Records that the device ran a range of `blocks` in `elapsed`
+  void finished(size_t device, uint32_t blocks,
+                std::chrono::nanoseconds elapsed);
+
+  // Ranges and blocks each device ran
+  std::vector<std::pair<size_t, uint64_t>> taken() const;
+
+ private:
+  struct Rate {
+    double expected;
+    uint64_t blocks = 0;  // run so far
+    std::chrono::nanoseconds elapsed{0};
+    size_t ranges = 0;
+  };
+
+  uint32_t blocks_;
+  uint32_t next_ = 0;
+  uint32_t min_range_;
+  mutable std::mutex mutex_;
+  std::vector<Rate> rates_;  // by device
+
+  // Called with mutex_ held
+  double rate(size_t device) const;
+};
+
+}  // namespace weft::steal
+
+#endif  // WEFT_BACKEND_STEAL_H
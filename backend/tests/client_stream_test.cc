@@ -0,0 +1,80 @@
+#define BOOST_TEST_MODULE client_stream
+#include <boost/test/included/unit_test.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "client_stream.h"
+#include "dataflow.h"
+#include "device.h"
+
+using weft::ClientStream;
+using weft::Dataflow;
+
+BOOST_AUTO_TEST_CASE(concurrent_dispatch_keeps_dataflow_order) {
+  constexpr int threads = 8;
+  constexpr int per_thread = 200;
+
+  std::vector<weft::Device> devices;
+  Dataflow dataflow;
+  std::mutex order_mutex;
+  std::vector<int> added, ran;
+  bool synchronized = false;
+  auto finished = [&] {
+    std::lock_guard<std::mutex> lock(order_mutex);
+    return synchronized;
+  };
+  {
+    ClientStream stream(devices);
+    // Every work writes Block 1, so each waits for the one added before it
+    Dataflow::Access access;
+    access.writes.push_back(1);
+    auto dispatch = [&] {
+      for (int i = 0; i < per_thread; ++i) {
+        auto done = std::make_shared<std::promise<void>>();
+        auto position = std::make_shared<int>();
+        stream.dispatch(
+            [&, done, position] {
+              std::lock_guard<std::mutex> lock(order_mutex);
+              *position = static_cast<int>(added.size());
+              added.push_back(*position);
+              return dataflow.add(access, done->get_future().share());
+            },
+            [&, done, position] {
+              {
+                std::lock_guard<std::mutex> lock(order_mutex);
+                ran.push_back(*position);
+              }
+              done->set_value();
+            });
+      }
+    };
+    std::vector<std::thread> dispatchers;
+    for (int i = 0; i < threads; ++i) dispatchers.emplace_back(dispatch);
+    for (auto &dispatcher : dispatchers) dispatcher.join();
+
+    // Deadlocks if work was queued ahead of what it waits for, and then the
+    // stream could never be destroyed either
+    std::thread([&] {
+      stream.synchronize();
+      std::lock_guard<std::mutex> lock(order_mutex);
+      synchronized = true;
+    }).detach();
+    for (int i = 0; i < 300 && !finished(); ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    if (!finished()) {
+      std::lock_guard<std::mutex> lock(order_mutex);
+      std::cerr << "deadlocked after " << ran.size() << " of " << added.size()
+                << " works\n";
+      std::_Exit(EXIT_FAILURE);
+    }
+  }
+  BOOST_TEST(ran.size() == added.size());
+  BOOST_TEST(ran == added);
+}
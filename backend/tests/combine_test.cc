@@ -0,0 +1,80 @@
+#define BOOST_TEST_MODULE combine
+#include <boost/test/included/unit_test.hpp>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "combine.h"
+
+namespace combine = weft::combine;
+using Param = weft::FunctionMetadata::Param;
+
+namespace {
+
+// Merges the partial into the data with the merger for T's element type
+template <typename T>
+std::vector<T> merged(combine::Op op, combine::Element element,
+                      std::vector<T> into, const std::vector<T> &partial) {
+  auto merge = combine::merger(op, element);
+  BOOST_TEST_REQUIRE(merge);
+  merge(into.data(), partial.data(), into.size() * sizeof(T));
+  return into;
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(sums) {
+  BOOST_TEST(merged<int32_t>(Param::SUM, Param::INT32, {1, -2, 3},
+                             {10, 20, -30}) ==
+             (std::vector<int32_t>{11, 18, -27}));
+  BOOST_TEST(merged<uint64_t>(Param::SUM, Param::UINT64, {1, 1ull << 40},
+                              {2, 1ull << 40}) ==
+             (std::vector<uint64_t>{3, 1ull << 41}));
+  BOOST_TEST(merged<float>(Param::SUM, Param::FLOAT32, {0.5f, -1.0f},
+                           {0.25f, 4.0f}) ==
+             (std::vector<float>{0.75f, 3.0f}));
+  BOOST_TEST(merged<double>(Param::SUM, Param::FLOAT64, {1e300}, {1e300}) ==
+             (std::vector<double>{2e300}));
+}
+
+BOOST_AUTO_TEST_CASE(minimums_and_maximums) {
+  BOOST_TEST(merged<int64_t>(Param::MIN, Param::INT64, {-5, 7, 0},
+                             {3, -8, 0}) ==
+             (std::vector<int64_t>{-5, -8, 0}));
+  BOOST_TEST(merged<uint32_t>(Param::MAX, Param::UINT32, {1, 0xffffffffu},
+                              {2, 0}) ==
+             (std::vector<uint32_t>{2, 0xffffffffu}));
+
+  // The identities the parts start from leave the other side unchanged
+  auto infinity = std::numeric_limits<float>::infinity();
+  BOOST_TEST(merged<float>(Param::MIN, Param::FLOAT32, {infinity, -1.5f},
+                           {2.5f, infinity}) ==
+             (std::vector<float>{2.5f, -1.5f}));
+  BOOST_TEST(merged<double>(Param::MAX, Param::FLOAT64, {-1.0 / 0.0, 4.0},
+                            {-3.0, -1.0 / 0.0}) ==
+             (std::vector<double>{-3.0, 4.0}));
+}
+
+BOOST_AUTO_TEST_CASE(bitwise_or) {
+  BOOST_TEST(merged<uint32_t>(Param::OR, Param::UINT32, {0x0f, 0x100},
+                              {0xf0, 0x1}) ==
+             (std::vector<uint32_t>{0xff, 0x101}));
+  BOOST_TEST(merged<int64_t>(Param::OR, Param::INT64, {1}, {-2}) ==
+             (std::vector<int64_t>{-1}));
+}
+
+BOOST_AUTO_TEST_CASE(only_whole_elements_are_merged) {
+  // Bytes past the last whole element are left alone
+  std::vector<int32_t> into{1, 2}, partial{10, 20};
+  combine::merger(Param::SUM, Param::INT32)(into.data(), partial.data(), 7);
+  BOOST_TEST(into == (std::vector<int32_t>{11, 2}));
+}
+
+BOOST_AUTO_TEST_CASE(no_merger_where_the_op_does_not_apply) {
+  BOOST_TEST(!combine::merger(Param::OR, Param::FLOAT32));
+  BOOST_TEST(!combine::merger(Param::OR, Param::FLOAT64));
+  BOOST_TEST(!combine::merger(Param::NONE, Param::INT32));
+  for (auto op : {Param::SUM, Param::MIN, Param::MAX, Param::OR}) {
+    BOOST_TEST(!combine::merger(op, Param::UNKNOWN));
+  }
+}
@@ -0,0 +1,116 @@
+#define BOOST_TEST_MODULE dataflow
+#include <boost/test/included/unit_test.hpp>
+#include <chrono>
+#include <future>
+#include <vector>
+
+#include "dataflow.h"
+
+using weft::Dataflow;
+
+namespace {
+
+// Work that finishes when the test says so
+struct Work {
+  std::promise<void> promise;
+  std::shared_future<void> done = promise.get_future().share();
+
+  void finish() { promise.set_value(); }
+};
+
+// Futures cannot be compared, so work waited for is told apart by finishing
+// it and counting what became ready
+size_t ready(const std::vector<std::shared_future<void>> &after) {
+  size_t count = 0;
+  for (const auto &work : after) {
+    if (work.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(first_use_waits_for_nothing) {
+  Dataflow dataflow;
+  Work work;
+  BOOST_TEST(dataflow.add({{1}, {2}}, work.done).empty());
+}
+
+BOOST_AUTO_TEST_CASE(readers_follow_the_writer_but_not_each_other) {
+  Dataflow dataflow;
+  Work writer, first, second;
+  dataflow.add({{}, {1}}, writer.done);
+  auto after_first = dataflow.add({{1}, {}}, first.done);
+  auto after_second = dataflow.add({{1}, {}}, second.done);
+  BOOST_TEST(after_first.size() == 1u);
+  BOOST_TEST(after_second.size() == 1u);
+
+  writer.finish();
+  BOOST_TEST(ready(after_first) == 1u);
+  BOOST_TEST(ready(after_second) == 1u);
+}
+
+BOOST_AUTO_TEST_CASE(writer_follows_the_writer_and_readers_since) {
+  Dataflow dataflow;
+  Work writer, first, second, next;
+  dataflow.add({{}, {1}}, writer.done);
+  dataflow.add({{1}, {}}, first.done);
+  dataflow.add({{1}, {}}, second.done);
+  auto after = dataflow.add({{}, {1}}, next.done);
+  BOOST_TEST(after.size() == 3u);
+
+  // Readers before the latest writer are covered by it
+  Work reader;
+  auto after_reader = dataflow.add({{1}, {}}, reader.done);
+  BOOST_TEST(after_reader.size() == 1u);
+
+  writer.finish();
+  first.finish();
+  second.finish();
+  BOOST_TEST(ready(after) == 3u);
+  BOOST_TEST(ready(after_reader) == 0u);
+  next.finish();
+  BOOST_TEST(ready(after_reader) == 1u);
+}
+
+BOOST_AUTO_TEST_CASE(other_blocks_do_not_order) {
+  Dataflow dataflow;
+  Work writer, other;
+  dataflow.add({{}, {1}}, writer.done);
+  BOOST_TEST(dataflow.add({{2}, {3}}, other.done).empty());
+}
+
+BOOST_AUTO_TEST_CASE(finished_work_is_not_waited_for) {
+  Dataflow dataflow;
+  Work writer, reader, next;
+  dataflow.add({{}, {1}}, writer.done);
+  dataflow.add({{1}, {}}, reader.done);
+  writer.finish();
+
+  auto after = dataflow.add({{}, {1}}, next.done);
+  BOOST_TEST(after.size() == 1u);
+  BOOST_TEST(ready(after) == 0u);
+  reader.finish();
+  BOOST_TEST(ready(after) == 1u);
+}
+
+BOOST_AUTO_TEST_CASE(hazards_are_not_recorded) {
+  Dataflow dataflow;
+  Work writer;
+  dataflow.add({{}, {1}}, writer.done);
+  BOOST_TEST(dataflow.hazards({{}, {1}}).size() == 1u);
+  // Had the copy been recorded as a writer, a read would follow both
+  BOOST_TEST(dataflow.hazards({{1}, {}}).size() == 1u);
+  writer.finish();
+  BOOST_TEST(dataflow.hazards({{1}, {1}}).empty());
+}
+
+BOOST_AUTO_TEST_CASE(erased_blocks_are_forgotten) {
+  Dataflow dataflow;
+  Work writer, next;
+  dataflow.add({{}, {1}}, writer.done);
+  dataflow.erase(1);
+  BOOST_TEST(dataflow.add({{1}, {1}}, next.done).empty());
+}
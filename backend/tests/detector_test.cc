@@ -0,0 +1,145 @@
+#define BOOST_TEST_MODULE detector
+#include <boost/test/included/unit_test.hpp>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "detector.h"
+
+using weft::graph::Detector;
+using weft::graph::Launch;
+
+namespace {
+
+// A launch of kernel `f`, told apart by its kernel, stream and geometry only
+Launch launch(uint64_t f, uint32_t grid = 1, uint64_t stream = 3) {
+  auto request = std::make_shared<weft::KernelLaunch>();
+  request->set_f(f);
+  request->set_griddimx(grid);
+  request->set_griddimy(1);
+  request->set_griddimz(1);
+  request->set_blockdimx(256);
+  request->set_blockdimy(1);
+  request->set_blockdimz(1);
+  request->set_hstream(stream);
+  return {nullptr, std::move(request)};
+}
+
+std::vector<uint64_t> kernels(const std::vector<Launch> &launches) {
+  std::vector<uint64_t> result;
+  for (const auto &launch : launches) result.push_back(launch.request->f());
+  return result;
+}
+
+// Observes the kernels, each running at once, as before a sequence is known
+void run_through(Detector &detector, const std::vector<uint64_t> &fs) {
+  for (auto f : fs) {
+    auto verdict = detector.observe(launch(f));
+    BOOST_TEST(kernels(verdict.flush) == std::vector<uint64_t>{f});
+    BOOST_TEST(verdict.batch.empty());
+  }
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(detects_after_three_iterations) {
+  Detector detector;
+  run_through(detector, {1, 2, 1, 2, 1});
+  BOOST_TEST(detector.length() == 0u);
+  run_through(detector, {2});
+  BOOST_TEST(detector.length() == 2u);
+
+  auto held = detector.observe(launch(1));
+  BOOST_TEST(held.flush.empty());
+  BOOST_TEST(held.batch.empty());
+  auto batch = detector.observe(launch(2));
+  BOOST_TEST(batch.flush.empty());
+  BOOST_TEST((kernels(batch.batch) == std::vector<uint64_t>{1, 2}));
+}
+
+BOOST_AUTO_TEST_CASE(finds_the_whole_period) {
+  Detector detector;
+  run_through(detector, {1, 1, 2, 1, 1, 2, 1, 1});
+  BOOST_TEST(detector.length() == 0u);
+  run_through(detector, {2});
+  BOOST_TEST(detector.length() == 3u);
+  detector.observe(launch(1));
+  detector.observe(launch(1));
+  auto batch = detector.observe(launch(2));
+  BOOST_TEST((kernels(batch.batch) == std::vector<uint64_t>{1, 1, 2}));
+}
+
+BOOST_AUTO_TEST_CASE(single_launch_is_no_sequence) {
+  Detector detector;
+  run_through(detector, {7, 7, 7, 7, 7});
+  BOOST_TEST(detector.length() == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(geometry_and_stream_count) {
+  Detector detector;
+  for (int i = 0; i < 3; ++i) {
+    detector.observe(launch(1));
+    detector.observe(launch(2));
+  }
+  BOOST_TEST(detector.length() == 2u);
+  detector.observe(launch(1));
+  auto wider = detector.observe(launch(2, 2));
+  BOOST_TEST((kernels(wider.flush) == std::vector<uint64_t>{1, 2}));
+  BOOST_TEST(detector.length() == 0u);
+
+  for (int i = 0; i < 3; ++i) {
+    detector.observe(launch(1));
+    detector.observe(launch(2));
+  }
+  detector.observe(launch(1));
+  auto other = detector.observe(launch(2, 1, 4));
+  BOOST_TEST((kernels(other.flush) == std::vector<uint64_t>{1, 2}));
+}
+
+BOOST_AUTO_TEST_CASE(divergence_flushes_in_order) {
+  Detector detector;
+  run_through(detector, {1, 2, 3, 1, 2, 3, 1, 2, 3});
+  BOOST_TEST(detector.length() == 3u);
+  detector.observe(launch(1));
+  detector.observe(launch(2));
+  auto diverged = detector.observe(launch(4));
+  BOOST_TEST(diverged.batch.empty());
+  BOOST_TEST((kernels(diverged.flush) == std::vector<uint64_t>{1, 2, 4}));
+  BOOST_TEST(detector.length() == 0u);
+
+  // The history starts over
+  run_through(detector, {1, 2, 3, 1, 2, 3, 1, 2});
+  BOOST_TEST(detector.length() == 0u);
+  run_through(detector, {3});
+  BOOST_TEST(detector.length() == 3u);
+}
+
+BOOST_AUTO_TEST_CASE(divergence_between_iterations) {
+  Detector detector;
+  run_through(detector, {1, 2, 1, 2, 1, 2});
+  detector.observe(launch(1));
+  detector.observe(launch(2));
+  auto diverged = detector.observe(launch(5));
+  BOOST_TEST((kernels(diverged.flush) == std::vector<uint64_t>{5}));
+  BOOST_TEST(detector.length() == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(release_keeps_the_sequence) {
+  Detector detector;
+  run_through(detector, {1, 2, 3, 1, 2, 3, 1, 2, 3});
+  detector.observe(launch(1));
+  detector.observe(launch(2));
+  BOOST_TEST((kernels(detector.release()) == std::vector<uint64_t>{1, 2}));
+  BOOST_TEST(detector.release().empty());
+  BOOST_TEST(detector.length() == 3u);
+
+  // The rest of the iteration is held, then too short for a graph
+  auto rest = detector.observe(launch(3));
+  BOOST_TEST(rest.batch.empty());
+  BOOST_TEST((kernels(rest.flush) == std::vector<uint64_t>{3}));
+
+  detector.observe(launch(1));
+  detector.observe(launch(2));
+  auto batch = detector.observe(launch(3));
+  BOOST_TEST((kernels(batch.batch) == std::vector<uint64_t>{1, 2, 3}));
+}
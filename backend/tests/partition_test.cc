@@ -0,0 +1,134 @@
+#define BOOST_TEST_MODULE partition
+#include <boost/test/included/unit_test.hpp>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "partition.h"
+#include "ptx.h"
+
+namespace partition = weft::partition;
+namespace ptx = weft::ptx;
+
+namespace {
+
+constexpr unsigned all_axes = ptx::axis_x | ptx::axis_y | ptx::axis_z;
+
+// Blocks each device gets along the axis, 0 for devices without a slice
+std::vector<uint32_t> shares(const std::vector<partition::Slice> &slices,
+                             size_t devices, size_t axis) {
+  std::vector<uint32_t> blocks(devices);
+  for (const auto &slice : slices) blocks[slice.device] = slice.dim[axis];
+  return blocks;
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(longest_allowed_axis) {
+  BOOST_TEST(partition::longest_axis({2, 8, 4}, all_axes) == 1u);
+  BOOST_TEST(partition::longest_axis({2, 8, 4},
+                                     ptx::axis_x | ptx::axis_z) == 2u);
+  BOOST_TEST(partition::longest_axis({1, 1, 1}, all_axes) == 3u);
+  BOOST_TEST(partition::longest_axis({8, 8, 8}, 0) == 3u);
+  // Ties go to the lowest axis
+  BOOST_TEST(partition::longest_axis({4, 4, 1}, all_axes) == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(unsplittable_grids_run_whole_on_device_0) {
+  for (std::array<uint32_t, 3> grid :
+       {std::array<uint32_t, 3>{16, 4, 2}, std::array<uint32_t, 3>{1, 1, 1}}) {
+    for (auto slices : {partition::split(grid, 0, {1, 1}),
+                        partition::split(grid, all_axes, {1})}) {
+      BOOST_TEST(slices.size() == 1u);
+      BOOST_TEST(slices[0].device == 0u);
+      BOOST_TEST(slices[0].dim == grid);
+      BOOST_TEST(slices[0].offset == (std::array<uint32_t, 3>{0, 0, 0}));
+    }
+  }
+  BOOST_TEST(partition::split({1, 1, 1}, all_axes, {1, 1}).size() == 1u);
+}
+
+BOOST_AUTO_TEST_CASE(splits_along_the_longest_axis_only) {
+  auto slices = partition::split({2, 8, 4}, all_axes, {1, 1});
+  BOOST_TEST(slices.size() == 2u);
+  BOOST_TEST(slices[0].dim == (std::array<uint32_t, 3>{2, 4, 4}));
+  BOOST_TEST(slices[0].offset == (std::array<uint32_t, 3>{0, 0, 0}));
+  BOOST_TEST(slices[1].dim == (std::array<uint32_t, 3>{2, 4, 4}));
+  BOOST_TEST(slices[1].offset == (std::array<uint32_t, 3>{0, 4, 0}));
+}
+
+BOOST_AUTO_TEST_CASE(shares_follow_the_weights) {
+  auto slices = partition::split({100, 1, 1}, all_axes, {2, 1});
+  // 66.67 and 33.33: the larger remainder takes the leftover block
+  BOOST_TEST(shares(slices, 2, 0) == (std::vector<uint32_t>{67, 33}));
+  BOOST_TEST(slices[1].offset[0] == 67u);
+}
+
+BOOST_AUTO_TEST_CASE(leftover_blocks_go_to_the_largest_remainders) {
+  // 4.2, 1.4 and 1.4 round down to 6 blocks of 7; device 1 has the largest
+  // remainder, tied with device 2, and comes first
+  auto slices = partition::split({7, 1, 1}, all_axes, {3, 1, 1});
+  BOOST_TEST(shares(slices, 3, 0) == (std::vector<uint32_t>{4, 2, 1}));
+
+  // Equal weights: 3.33 each, the first device takes the leftover block
+  slices = partition::split({1, 1, 10}, all_axes, {1, 1, 1});
+  BOOST_TEST(shares(slices, 3, 2) == (std::vector<uint32_t>{4, 3, 3}));
+  BOOST_TEST(slices[1].offset[2] == 4u);
+  BOOST_TEST(slices[2].offset[2] == 7u);
+
+  // 1.75, 1.75 and 3.5 leave 2 blocks, for the two remainders of 0.75
+  slices = partition::split({7, 1, 1}, all_axes, {1, 1, 2});
+  BOOST_TEST(shares(slices, 3, 0) == (std::vector<uint32_t>{2, 2, 3}));
+}
+
+BOOST_AUTO_TEST_CASE(devices_with_empty_shares_get_no_slice) {
+  auto slices = partition::split({4, 1, 1}, all_axes, {1, 0, 1});
+  BOOST_TEST(slices.size() == 2u);
+  BOOST_TEST(slices[0].device == 0u);
+  BOOST_TEST(slices[1].device == 2u);
+  BOOST_TEST(slices[1].offset[0] == 2u);
+
+  // More devices than blocks
+  slices = partition::split({2, 1, 1}, all_axes, {1, 1, 1, 1});
+  BOOST_TEST(slices.size() == 2u);
+}
+
+BOOST_AUTO_TEST_CASE(zero_weights_share_equally) {
+  auto slices = partition::split({9, 1, 1}, all_axes, {0, 0, 0});
+  BOOST_TEST(shares(slices, 3, 0) == (std::vector<uint32_t>{3, 3, 3}));
+}
+
+BOOST_AUTO_TEST_CASE(every_block_runs_exactly_once) {
+  std::mt19937 random(44);
+  std::uniform_int_distribution<uint32_t> dim(1, 5000);
+  std::uniform_int_distribution<size_t> devices(2, 8);
+  std::uniform_real_distribution<double> weight(0.1, 10);
+  for (int run = 0; run < 1000; ++run) {
+    std::array<uint32_t, 3> grid{dim(random), dim(random) % 64 + 1,
+                                 dim(random) % 8 + 1};
+    std::vector<double> weights(devices(random));
+    for (auto &w : weights) w = weight(random);
+    auto total = std::accumulate(weights.begin(), weights.end(), 0.0);
+
+    auto axis = partition::longest_axis(grid, all_axes);
+    auto slices = partition::split(grid, all_axes, weights);
+    uint32_t offset = 0;
+    for (const auto &slice : slices) {
+      BOOST_TEST(slice.offset[axis] == offset);
+      BOOST_TEST(slice.dim[axis] > 0u);
+      // Within a block of the exact share
+      BOOST_TEST(std::abs(slice.dim[axis] -
+                          grid[axis] * weights[slice.device] / total) < 1.0);
+      for (size_t other = 0; other < grid.size(); ++other) {
+        if (other == axis) continue;
+        BOOST_TEST(slice.dim[other] == grid[other]);
+        BOOST_TEST(slice.offset[other] == 0u);
+      }
+      offset += slice.dim[axis];
+    }
+    BOOST_TEST(offset == grid[axis]);
+  }
+}
@@ -0,0 +1,60 @@
+#define BOOST_TEST_MODULE pipeline
+#include <boost/test/included/unit_test.hpp>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "pipeline.h"
+
+using Waves = std::vector<std::pair<uint32_t, uint32_t>>;
+
+BOOST_AUTO_TEST_CASE(cut_even) {
+  BOOST_TEST((weft::pipeline::cut(0, 8, 4) ==
+              Waves{{0, 2}, {2, 2}, {4, 2}, {6, 2}}));
+}
+
+BOOST_AUTO_TEST_CASE(cut_uneven_from_offset) {
+  // A slice of a split launch starts at its block offset
+  BOOST_TEST((weft::pipeline::cut(10, 10, 3) ==
+              Waves{{10, 3}, {13, 3}, {16, 4}}));
+}
+
+BOOST_AUTO_TEST_CASE(cut_more_waves_than_blocks) {
+  BOOST_TEST((weft::pipeline::cut(5, 2, 4) == Waves{{5, 1}, {6, 1}}));
+  BOOST_TEST((weft::pipeline::cut(5, 2, 0) == Waves{{5, 2}}));
+}
+
+BOOST_AUTO_TEST_CASE(cut_covers_blocks) {
+  for (uint32_t blocks = 1; blocks < 100; ++blocks) {
+    for (unsigned waves = 1; waves < 10; ++waves) {
+      auto cut = weft::pipeline::cut(7, blocks, waves);
+      BOOST_TEST(cut.size() == std::min(blocks, waves));
+      uint32_t next = 7;
+      for (auto [offset, size] : cut) {
+        BOOST_TEST(offset == next);
+        BOOST_TEST(size >= blocks / waves);
+        BOOST_TEST(size <= blocks / waves + 1);
+        next = offset + size;
+      }
+      BOOST_TEST(next == 7 + blocks);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(element_size_known_pointee) {
+  BOOST_TEST(weft::pipeline::element_size(4000, 4, 1000, 256) == 4u);
+  // Threads rounded up to whole blocks
+  BOOST_TEST(weft::pipeline::element_size(4000, 4, 1024, 256) == 4u);
+  // More elements than threads, or a block too few
+  BOOST_TEST(weft::pipeline::element_size(8000, 4, 1000, 256) == 0u);
+  BOOST_TEST(weft::pipeline::element_size(4 * 768, 4, 1024, 256) == 0u);
+  BOOST_TEST(weft::pipeline::element_size(4001, 4, 1000, 256) == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(element_size_inferred) {
+  BOOST_TEST(weft::pipeline::element_size(4000, 0, 1000, 256) == 4u);
+  BOOST_TEST(weft::pipeline::element_size(8000, 0, 1024, 256) == 8u);
+  BOOST_TEST(weft::pipeline::element_size(1000, 0, 1000, 256) == 1u);
+  BOOST_TEST(weft::pipeline::element_size(4001, 0, 1024, 256) == 0u);
+  BOOST_TEST(weft::pipeline::element_size(64 * 1024, 0, 1024, 256) == 0u);
+}
@@ -0,0 +1,179 @@
+#define BOOST_TEST_MODULE ptx
+#include <boost/test/included/unit_test.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ptx.h"
+
+namespace ptx = weft::ptx;
+
+namespace {
+
+constexpr unsigned all_axes = ptx::axis_x | ptx::axis_y | ptx::axis_z;
+
+const std::string header =
+    ".version 7.0\n"
+    ".target sm_70\n"
+    ".address_size 64\n\n";
+
+size_t count(std::string_view text, std::string_view word) {
+  size_t found = 0;
+  for (auto pos = text.find(word); pos != std::string_view::npos;
+       pos = text.find(word, pos + 1)) {
+    ++found;
+  }
+  return found;
+}
+
+// The rewritten entry, from its .entry to the closing brace
+std::string_view entry(std::string_view ptx, std::string_view name) {
+  auto begin = ptx.find(".entry " + std::string(name));
+  auto end = ptx.find("\n}", begin);
+  return ptx.substr(begin, end + 2 - begin);
+}
+
+std::string marker(const std::string &name, unsigned axes) {
+  return ".visible .global .align 4 .u32 " + ptx::split_marker(name) +
+         " = " + std::to_string(axes) + ";";
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(offsets_all_three_axes) {
+  auto split = ptx::split(header +
+                          ".visible .entry grid3(\n"
+                          "\t.param .u64 grid3_param_0\n"
+                          ")\n"
+                          "{\n"
+                          "\t.reg .b32 %r<7>;\n"
+                          "\tmov.u32 %r1, %ctaid.x;\n"
+                          "\tmov.u32 %r2, %ctaid.y;\n"
+                          "\tmov.u32 %r3, %ctaid.z;\n"
+                          "\tmov.u32 %r4, %nctaid.x;\n"
+                          "\tmov.u32 %r5, %nctaid.y;\n"
+                          "\tmov.u32 %r6, %nctaid.z;\n"
+                          "\tret;\n"
+                          "}\n");
+  BOOST_TEST(split.entries == std::vector<std::string>{"grid3"});
+  BOOST_TEST(split.skipped.empty());
+  BOOST_TEST(split.ptx.find(marker("grid3", all_axes)) != std::string::npos);
+
+  auto body = entry(split.ptx, "grid3");
+  // The parameters the launch appends, after the kernel's own
+  BOOST_TEST(body.find("\t.param .u64 grid3_param_0,\n"
+                       "\t.param .u32 _weft_blockOffsetX,\n"
+                       "\t.param .u32 _weft_blockOffsetY,\n"
+                       "\t.param .u32 _weft_blockOffsetZ,\n"
+                       "\t.param .u32 _weft_gridDimX,\n"
+                       "\t.param .u32 _weft_gridDimY,\n"
+                       "\t.param .u32 _weft_gridDimZ\n)") !=
+             std::string_view::npos);
+  for (std::string axis : {"x", "y", "z"}) {
+    std::string upper(1, static_cast<char>(axis[0] - 'a' + 'A'));
+    auto ctaid = "%_weft_ctaid_" + axis, nctaid = "%_weft_nctaid_" + axis;
+    // Only the prologue reads the hardware registers
+    BOOST_TEST(count(body, "%ctaid." + axis) == 1u);
+    BOOST_TEST(count(body, "%nctaid." + axis) == 0u);
+    BOOST_TEST(body.find("ld.param.u32 " + ctaid + ", [_weft_blockOffset" +
+                         upper + "];\n\tmov.u32 " + nctaid + ", %ctaid." +
+                         axis + ";\n\tadd.u32 " + ctaid + ", " + ctaid + ", " +
+                         nctaid + ";\n\tld.param.u32 " + nctaid +
+                         ", [_weft_gridDim" + upper + "];") !=
+               std::string_view::npos);
+  }
+  BOOST_TEST(body.find("mov.u32 %r2, %_weft_ctaid_y;") !=
+             std::string_view::npos);
+  BOOST_TEST(body.find("mov.u32 %r6, %_weft_nctaid_z;") !=
+             std::string_view::npos);
+}
+
+BOOST_AUTO_TEST_CASE(entries_without_parameters_get_the_new_ones) {
+  auto split = ptx::split(header +
+                          ".visible .entry empty()\n"
+                          "{\n\tret;\n}\n"
+                          ".visible .entry bare\n"
+                          "{\n\tret;\n}\n");
+  BOOST_TEST(split.entries == (std::vector<std::string>{"empty", "bare"}));
+  BOOST_TEST(entry(split.ptx, "empty")
+                 .find("empty(\n\t.param .u32 _weft_blockOffsetX,") !=
+             std::string_view::npos);
+  BOOST_TEST(entry(split.ptx, "bare")
+                 .find("bare(\n\t.param .u32 _weft_blockOffsetX,") !=
+             std::string_view::npos);
+}
+
+BOOST_AUTO_TEST_CASE(functions_only_rule_out_the_axes_they_read) {
+  auto split = ptx::split(header +
+                          ".func (.param .b32 ret) row()\n"
+                          "{\n"
+                          "\t.reg .b32 %r<2>;\n"
+                          "\tmov.u32 %r1, %ctaid.y;\n"
+                          "\tst.param.b32 [ret], %r1;\n"
+                          "\tret;\n"
+                          "}\n"
+                          ".func (.param .b32 ret) outer()\n"
+                          "{\n"
+                          "\tcall (ret), row, ();\n"
+                          "\tret;\n"
+                          "}\n"
+                          ".visible .entry direct()\n"
+                          "{\n\tcall (%r1), row, ();\n\tret;\n}\n"
+                          ".visible .entry transitive()\n"
+                          "{\n\tcall (%r1), outer, ();\n\tret;\n}\n"
+                          ".visible .entry unrelated()\n"
+                          "{\n\tret;\n}\n");
+  BOOST_TEST(split.entries ==
+             (std::vector<std::string>{"direct", "transitive", "unrelated"}));
+  auto xz = ptx::axis_x | ptx::axis_z;
+  BOOST_TEST(split.ptx.find(marker("direct", xz)) != std::string::npos);
+  BOOST_TEST(split.ptx.find(marker("transitive", xz)) != std::string::npos);
+  BOOST_TEST(split.ptx.find(marker("unrelated", all_axes)) !=
+             std::string::npos);
+  // The function itself is left as it was
+  BOOST_TEST(split.ptx.find("\tmov.u32 %r1, %ctaid.y;\n\tst.param") !=
+             std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(skips_what_cannot_be_adjusted) {
+  auto split = ptx::split(header +
+                          ".func all()\n"
+                          "{\n"
+                          "\tmov.u32 %r1, %ctaid.x;\n"
+                          "\tmov.u32 %r2, %nctaid.y;\n"
+                          "\tmov.u32 %r3, %ctaid.z;\n"
+                          "\tret;\n"
+                          "}\n"
+                          ".visible .entry every_axis()\n"
+                          "{\n\tcall.uni all, ();\n\tret;\n}\n"
+                          ".visible .entry vector()\n"
+                          "{\n\tmov.v4.u32 {%r1, %r2, %r3, %r4}, %ctaid;\n"
+                          "\tret;\n}\n"
+                          ".visible .entry cluster()\n"
+                          "{\n\tmov.u32 %r1, %clusterid.x;\n\tret;\n}\n");
+  BOOST_TEST(split.entries.empty());
+  BOOST_TEST(split.skipped ==
+             (std::vector<std::string>{"every_axis", "vector", "cluster"}));
+  BOOST_TEST(split.ptx.find("_weft") == std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(declarations_are_not_rewritten) {
+  auto source = header +
+                ".extern .func (.param .b32 ret) vprintf(\n"
+                "\t.param .b64 format,\n"
+                "\t.param .b64 args\n"
+                ");\n"
+                ".visible .entry print(\n"
+                "\t.param .u64 print_param_0\n"
+                ")\n"
+                ".maxntid 256, 1, 1\n"
+                "{\n\tmov.u32 %r1, %ctaid.x;\n\tret;\n}\n";
+  auto split = ptx::split(source);
+  BOOST_TEST(split.entries == std::vector<std::string>{"print"});
+  // Everything before the entry is copied as it was
+  auto before = source.find(".visible .entry");
+  BOOST_TEST(split.ptx.compare(0, before, source, 0, before) == 0);
+  // So are directives between the signature and the body
+  BOOST_TEST(entry(split.ptx, "print").find(")\n.maxntid 256, 1, 1\n{") !=
+             std::string_view::npos);
+}
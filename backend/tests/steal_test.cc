@@ -0,0 +1,142 @@
+#define BOOST_TEST_MODULE steal
+#include <boost/test/included/unit_test.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "steal.h"
+
+using weft::steal::BlockRanges;
+
+namespace {
+
+std::chrono::nanoseconds units(double time) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::duration<double>(time));
+}
+
+// Runs a launch of `blocks` in virtual time on devices running the given
+// blocks per time unit, each asking for a range as soon as it is free.
+// Returns when each device finished.
+std::vector<double> simulate(BlockRanges &ranges,
+                             const std::vector<double> &speeds) {
+  std::vector<double> free(speeds.size(), 0);
+  std::vector<bool> done(speeds.size(), false);
+  for (;;) {
+    size_t device = speeds.size();
+    for (size_t i = 0; i < speeds.size(); ++i) {
+      if (!done[i] && (device == speeds.size() || free[i] < free[device])) {
+        device = i;
+      }
+    }
+    if (device == speeds.size()) return free;
+
+    auto range = ranges.next(device);
+    if (!range) {
+      done[device] = true;
+      continue;
+    }
+    auto elapsed = range->second / speeds[device];
+    free[device] += elapsed;
+    ranges.finished(device, range->second, units(elapsed));
+  }
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(hands_out_every_block_once_in_order) {
+  BlockRanges ranges(1000, {1, 2, 3});
+  uint32_t next = 0;
+  for (size_t device = 0;; device = (device + 1) % 3) {
+    auto range = ranges.next(device);
+    if (!range) break;
+    BOOST_TEST(range->first == next);
+    BOOST_TEST(range->second > 0u);
+    next += range->second;
+    ranges.finished(device, range->second, units(1));
+  }
+  BOOST_TEST(next == 1000u);
+  for (size_t device = 0; device < 3; ++device) {
+    BOOST_TEST(!ranges.next(device));
+  }
+
+  uint64_t blocks = 0;
+  for (auto [count, taken] : ranges.taken()) {
+    BOOST_TEST(count > 0u);
+    blocks += taken;
+  }
+  BOOST_TEST(blocks == 1000u);
+}
+
+BOOST_AUTO_TEST_CASE(first_ranges_are_half_the_expected_share) {
+  BlockRanges ranges(1000, {1, 3});
+  // A quarter of the blocks is device 0's share, and it takes half of that
+  auto first = ranges.next(0);
+  BOOST_TEST(first->first == 0u);
+  BOOST_TEST(first->second == 125u);
+  // Three quarters of the remaining 875, halved and rounded up
+  auto second = ranges.next(1);
+  BOOST_TEST(second->first == 125u);
+  BOOST_TEST(second->second == 329u);
+}
+
+BOOST_AUTO_TEST_CASE(ranges_follow_measured_throughput) {
+  BlockRanges ranges(10000, {1, 1});
+  auto slow = ranges.next(0);
+  ranges.finished(0, slow->second, units(4));
+  auto fast = ranges.next(1);
+  ranges.finished(1, fast->second, units(1));
+  // Equal expected weights, but device 1 ran four times the blocks per unit
+  auto slow_next = ranges.next(0)->second;
+  auto fast_next = ranges.next(1)->second;
+  BOOST_TEST(fast_next > 2 * slow_next);
+}
+
+BOOST_AUTO_TEST_CASE(unmeasured_devices_scale_with_the_measured) {
+  BlockRanges ranges(10000, {1, 2});
+  auto first = ranges.next(0);
+  BOOST_TEST(first->second == 1667u);
+  // Device 1 has not run yet, so it is assumed to run twice the blocks per
+  // unit that device 0 measured, rather than at its raw expected weight:
+  // two thirds of the remaining 8333, halved
+  ranges.finished(0, first->second, units(10));
+  BOOST_TEST(ranges.next(1)->second == 2778u);
+}
+
+BOOST_AUTO_TEST_CASE(ranges_do_not_shrink_below_the_floor) {
+  // 16 ranges per device at most: 1000 / (2 * 16) = 31 blocks
+  BlockRanges ranges(1000, {1, 1});
+  uint32_t smallest = 1000, count = 0;
+  while (auto range = ranges.next(count % 2)) {
+    if (range->first + range->second < 1000) {
+      smallest = std::min(smallest, range->second);
+    }
+    ++count;
+  }
+  BOOST_TEST(smallest >= 31u);
+  BOOST_TEST(count <= 32u);
+
+  // Small grids still go one block at a time at the least
+  BlockRanges tiny(3, {1, 1, 1, 1});
+  uint32_t blocks = 0;
+  while (auto range = tiny.next(0)) blocks += range->second;
+  BOOST_TEST(blocks == 3u);
+}
+
+BOOST_AUTO_TEST_CASE(slow_device_takes_fewer_blocks) {
+  // Two devices expected to be equal, one running at a quarter of the
+  // other's speed. A static even split finishes when the slow one has run
+  // its 500 blocks, at 20 units; ideally both finish at 1000 / 125 = 8.
+  BlockRanges ranges(1000, {1, 1});
+  auto finished = simulate(ranges, {100, 25});
+  auto [first, last] = std::minmax_element(finished.begin(), finished.end());
+  BOOST_TEST_MESSAGE("finished at " << finished[0] << " and " << finished[1]
+                                    << " units");
+  BOOST_TEST(*last < 10.0);
+  BOOST_TEST(*last - *first < 1.5);
+
+  auto taken = ranges.taken();
+  BOOST_TEST(taken[0].second + taken[1].second == 1000u);
+  BOOST_TEST(taken[0].second > 3 * taken[1].second);
+}
@@ -0,0 +1,59 @@
+#include "worker.h"
+
+#include <cuda.h>
+
+#include <atomic>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <utility>
+
+#include "CUDA_samples/helper_cuda_drvapi.h"
+
+namespace weft {
+
+Worker::Worker(CUcontext context)
+    : tasks_{64}, thread_{&Worker::run, this, context} {}
+
+Worker::~Worker() {
+  push(nullptr);
+  thread_.join();
+}
+
+std::future<void> Worker::submit(std::function<void()> task) {
+  auto packaged = new Task(std::move(task));
+  auto future = packaged->get_future();
+  push(packaged);
+  return future;
+}
+
+void Worker::push(Task *task) {
+  tasks_.push(task);
+  // Only sleeps happen under the mutex, so it is uncontended while busy
+  if (pending_.fetch_add(1, std::memory_order_release) == 0) {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    wake_.notify_one();
+  }
+}
+
+void Worker::run(CUcontext context) {
+  if (context) checkCudaErrors(cuCtxSetCurrent(context));
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(wake_mutex_);
+      wake_.wait(lock, [this] {
+        return pending_.load(std::memory_order_acquire) != 0;
+      });
+    }
+
+    Task *task;
+    while (tasks_.pop(task)) {
+      pending_.fetch_sub(1, std::memory_order_relaxed);
+      if (!task) return;
+      (*task)();
+      delete task;
+    }
+  }
+}
+
+}  // namespace weft
@@ -0,0 +1,45 @@
+#ifndef WEFT_BACKEND_WORKER_H
+#define WEFT_BACKEND_WORKER_H
+
+#include <cuda.h>
+
+#include <boost/lockfree/queue.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+
+namespace weft {
+
+// Long-lived thread fed through a lock-free queue, so running work neither
+// creates threads nor rebinds the context. Tasks run in submission order.
+class Worker {
+ public:
+  // The context, if any, is bound once for the thread's lifetime
+  explicit Worker(CUcontext context = nullptr);
+  // Runs what is still queued first
+  ~Worker();
+
+  Worker(const Worker &) = delete;
+  Worker &operator=(const Worker &) = delete;
+
+  std::future<void> submit(std::function<void()> task);
+
+ private:
+  using Task = std::packaged_task<void()>;
+
+  boost::lockfree::queue<Task *> tasks_;  // null stops the worker
+  std::atomic<size_t> pending_{0};
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  std::thread thread_;
+
+  void push(Task *task);
+  void run(CUcontext context);
+};
+
+}  // namespace weft
+
+#endif  // WEFT_BACKEND_WORKER_H
@@ -4,13 +4,21 @@
 #include <grpcpp/client_context.h>
 
 #include <boost/range/adaptor/indexed.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
 
-#include "nvrtc/kernel_parser.h"
+#include "kernel_metadata.h"
 #include "weft.grpc.pb.h"
+#include "weft/image.h"
 
 namespace weft {
 
@@ -21,6 +29,150 @@ using grpc::Status;
 
 constexpr size_t chunk_size = 64 * 1024;
 
+// Driver error for a failed RPC, e.g. a launch reported by the server
+static CUresult to_result(const Status &status) {
+  switch (status.error_code()) {
+    case grpc::StatusCode::OK:
+      return CUDA_SUCCESS;
+    case grpc::StatusCode::RESOURCE_EXHAUSTED:
+      return CUDA_ERROR_LAUNCH_OUT_OF_RESOURCES;
+    case grpc::StatusCode::INTERNAL:
+      return CUDA_ERROR_LAUNCH_FAILED;
+    case grpc::StatusCode::INVALID_ARGUMENT:
+      return CUDA_ERROR_INVALID_HANDLE;
+    case grpc::StatusCode::FAILED_PRECONDITION:
+      return CUDA_ERROR_NOT_READY;
+    default:
+      return CUDA_ERROR_UNKNOWN;
+  }
+}
+
+class CudaDriverClient::Launcher {
+ public:
+  explicit Launcher(CudaDriver::Stub *stub)
+      : stub_{stub}, thread_{&Launcher::run, this} {}
+
+  // Sends what is still queued first
+  ~Launcher() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+  }
+
+  // Queues an RPC that must reach the server in order with launches
+  void push(std::function<Status()> send) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back(std::move(send));
+    }
+    changed_.notify_all();
+  }
+
+  Status flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this] { return queue_.empty() && !sending_; });
+    return std::exchange(failure_, Status::OK);
+  }
+
+ private:
+  CudaDriver::Stub *stub_;
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::deque<std::function<Status()>> queue_;
+  bool sending_ = false;
+  bool stopping_ = false;
+  Status failure_;  // first since the last flush
+  std::thread thread_;
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      changed_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+      if (queue_.empty()) return;
+
+      auto send = std::move(queue_.front());
+      queue_.pop_front();
+      sending_ = true;
+      lock.unlock();
+
+      Status status = send();
+
+      lock.lock();
+      sending_ = false;
+      if (!status.ok() && failure_.ok()) failure_ = status;
+      if (queue_.empty()) changed_.notify_all();
+    }
+  }
+};
+
+// Holds the Session RPC open, reopening it if the connection drops, so the
+// server keeps this client's state while it runs and drops it after
+class CudaDriverClient::Session {
+ public:
+  explicit Session(CudaDriver::Stub *stub)
+      : stub_{stub}, thread_{&Session::run, this} {}
+
+  ~Session() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+      if (context_) context_->TryCancel();
+    }
+    stopped_.notify_all();
+    thread_.join();
+  }
+
+ private:
+  CudaDriver::Stub *stub_;
+  std::mutex mutex_;
+  std::condition_variable stopped_;
+  ClientContext *context_ = nullptr;  // of the open RPC
+  bool stopping_ = false;
+  std::thread thread_;
+
+  void run() {
+    constexpr auto retry = std::chrono::seconds(1);
+
+    for (;;) {
+      ClientContext context;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) return;
+        context_ = &context;
+      }
+      auto reader = stub_->Session(&context, Empty{});
+      Empty message;
+      while (reader->Read(&message)) {
+      }
+      reader->Finish();
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      context_ = nullptr;
+      if (stopped_.wait_for(lock, retry, [this] { return stopping_; })) return;
+    }
+  }
+};
+
+CudaDriverClient::CudaDriverClient() = default;
+
+CudaDriverClient::CudaDriverClient(std::shared_ptr<grpc::Channel> channel)
+    : stub_{CudaDriver::NewStub(channel)},
+      session_{std::make_unique<Session>(stub_.get())},
+      launcher_{std::make_unique<Launcher>(stub_.get())} {}
+
+CudaDriverClient::~CudaDriverClient() = default;
+
+CudaDriverClient::CudaDriverClient(CudaDriverClient &&) noexcept = default;
+CudaDriverClient &CudaDriverClient::operator=(CudaDriverClient &&) noexcept =
+    default;
+
+CUresult CudaDriverClient::flush() {
+  return launcher_ ? to_result(launcher_->flush()) : CUDA_SUCCESS;
+}
+
 uint64_t CudaDriverClient::MemAlloc(size_t size) {
   ClientContext context;
   Size request;
@@ -34,7 +186,9 @@ uint64_t CudaDriverClient::MemAlloc(size_t size) {
   return response.handle();
 }
 
-void CudaDriverClient::MemFree(uint64_t dptr) {
+CUresult CudaDriverClient::MemFree(uint64_t dptr) {
+  if (auto result = flush(); result != CUDA_SUCCESS) return result;
+
   ClientContext context;
   DevicePointer request;
   Empty response;
@@ -44,9 +198,12 @@ void CudaDriverClient::MemFree(uint64_t dptr) {
   if (!status.ok()) {
     std::cerr << "RPC MemFree Failed!\n\t" << status.error_message() << "\n";
   }
+  return to_result(status);
 }
 
-void CudaDriverClient::MemcpyHtoD(uint64_t dptr, std::string_view src) {
+CUresult CudaDriverClient::MemcpyHtoD(uint64_t dptr, std::string_view src) {
+  if (auto result = flush(); result != CUDA_SUCCESS) return result;
+
   ClientContext context;
   MemoryWrite chunk;
   Empty response;
@@ -71,9 +228,12 @@ void CudaDriverClient::MemcpyHtoD(uint64_t dptr, std::string_view src) {
   if (!status.ok()) {
     std::cerr << "RPC MemcpyHtoD Failed!\n\t" << status.error_message() << "\n";
   }
+  return to_result(status);
 }
 
-void CudaDriverClient::MemcpyDtoH(void *dst, uint64_t sptr, size_t size) {
+CUresult CudaDriverClient::MemcpyDtoH(void *dst, uint64_t sptr, size_t size) {
+  if (auto result = flush(); result != CUDA_SUCCESS) return result;
+
   ClientContext context;
   MemoryRead request;
   MemoryChunk chunk;
@@ -93,11 +253,34 @@ void CudaDriverClient::MemcpyDtoH(void *dst, uint64_t sptr, size_t size) {
   if (!status.ok()) {
     std::cerr << "RPC MemcpyDtoH Failed!\n\t" << status.error_message() << "\n";
   }
+  return to_result(status);
+}
+
+static FunctionMetadata::Param::Access to_access(Access access) {
+  switch (access) {
+    case Access::read_only:
+      return FunctionMetadata::Param::READ_ONLY;
+    case Access::write_only:
+      return FunctionMetadata::Param::WRITE_ONLY;
+    case Access::unused:
+      return FunctionMetadata::Param::UNUSED;
+    default:
+      return FunctionMetadata::Param::READ_WRITE;
+  }
+}
+
+// Both enums follow the proto's order
+static FunctionMetadata::Param::Combine to_combine(Combine combine) {
+  return static_cast<FunctionMetadata::Param::Combine>(combine);
+}
+
+static FunctionMetadata::Param::Element to_element(Element element) {
+  return static_cast<FunctionMetadata::Param::Element>(element);
 }
 
 uint64_t CudaDriverClient::ModuleGetFunction(
     uint64_t hmod, std::string name,
-    const std::vector<weft::nvrtc::Param> &params) {
+    const std::vector<Param> &params) {
   ClientContext context;
   FunctionMetadata request;
   Function response;
@@ -110,6 +293,7 @@ uint64_t CudaDriverClient::ModuleGetFunction(
     request_param->set_size(param.size());
     request_param->set_is_pointer(param.is_pointer());
     request_param->set_is_const(param.is_const());
+    request_param->set_access(to_access(param.access()));
   }
 
   Status status = stub_->ModuleGetFunction(&context, request, &response);
@@ -120,13 +304,28 @@ uint64_t CudaDriverClient::ModuleGetFunction(
   return response.handle();
 }
 
-uint64_t CudaDriverClient::ModuleLoadData(std::string image) {
+uint64_t CudaDriverClient::ModuleLoadData(const Image &image) {
+  // Try by hash first: the server keeps modules across restarts, so identical
+  // jobs skip the upload entirely
+  {
+    ClientContext context;
+    ModuleHash request;
+    Module response;
+
+    request.set_hash(hash(image));
+    Status status = stub_->ModuleLoadCached(&context, request, &response);
+    if (status.ok()) {
+      return response.handle();
+    } else if (status.error_code() != grpc::StatusCode::NOT_FOUND) {
+      std::cerr << "RPC ModuleLoadCached Failed!\n\t"
+                << status.error_message() << "\n";
+    }
+  }
+
   ClientContext context;
-  PTX request;
   Module response;
 
-  request.set_str(image);
-  Status status = stub_->ModuleLoadData(&context, request, &response);
+  Status status = stub_->ModuleLoadData(&context, image, &response);
   if (!status.ok()) {
     std::cerr << "RPC ModuleLoadData Failed!\n\t" << status.error_message()
               << "\n";
@@ -138,11 +337,8 @@ void CudaDriverClient::LaunchKernel(
     uint64_t f, uint32_t gridDimX, uint32_t gridDimY, uint32_t gridDimZ,
     uint32_t blockDimX, uint32_t blockDimY, uint32_t blockDimZ,
     uint32_t sharedMemBytes, uint64_t hStream,
-    const std::vector<weft::nvrtc::Param> &metadata, void *kernelParams[]) {
-  ClientContext context;
+    const std::vector<Param> &metadata, void *kernelParams[]) {
   KernelLaunch request;
-  Empty response;
-
   request.set_f(f);
   request.set_griddimx(gridDimX);
   request.set_griddimy(gridDimY);
@@ -161,13 +357,194 @@ void CudaDriverClient::LaunchKernel(
     request_param->set_is_pointer(param.value().is_pointer());
     request_param->set_is_const(param.value().is_const());
     request_param->set_data(kernelParams[param.index()], param.value().size());
+    if (param.value().combine() != Combine::none) {
+      request_param->set_combine(to_combine(param.value().combine()));
+      request_param->set_element(to_element(param.value().element()));
+    }
+    request_param->set_elementwise(param.value().elementwise());
+  }
+
+  launcher_->push([stub = stub_.get(), request = std::move(request)] {
+    ClientContext context;
+    Empty response;
+    Status status = stub->LaunchKernel(&context, request, &response);
+    if (!status.ok()) {
+      std::cerr << "RPC LaunchKernel Failed!\n\t" << status.error_message()
+                << "\n";
+    }
+    return status;
+  });
+}
+
+CUresult CudaDriverClient::Synchronize() {
+  if (auto result = flush(); result != CUDA_SUCCESS) return result;
+
+  ClientContext context;
+  Empty request;
+  Empty response;
+  Status status = stub_->Synchronize(&context, request, &response);
+  if (!status.ok()) {
+    std::cerr << "RPC Synchronize Failed!\n\t" << status.error_message()
+              << "\n";
+  }
+  return to_result(status);
+}
+
+CUresult CudaDriverClient::StreamCreate(uint64_t *stream) {
+  ClientContext context;
+  Empty request;
+  Stream response;
+  Status status = stub_->StreamCreate(&context, request, &response);
+  if (!status.ok()) {
+    std::cerr << "RPC StreamCreate Failed!\n\t" << status.error_message()
+              << "\n";
+  }
+  *stream = response.handle();
+  return to_result(status);
+}
+
+CUresult CudaDriverClient::StreamDestroy(uint64_t stream) {
+  // Launches still queued here may be on it
+  if (auto result = flush(); result != CUDA_SUCCESS) return result;
+
+  ClientContext context;
+  Stream request;
+  Empty response;
+  request.set_handle(stream);
+  Status status = stub_->StreamDestroy(&context, request, &response);
+  if (!status.ok()) {
+    std::cerr << "RPC StreamDestroy Failed!\n\t" << status.error_message()
+              << "\n";
+  }
+  return to_result(status);
+}
+
+CUresult CudaDriverClient::StreamSynchronize(uint64_t stream) {
+  if (auto result = flush(); result != CUDA_SUCCESS) return result;
+
+  ClientContext context;
+  Stream request;
+  Empty response;
+  request.set_handle(stream);
+  Status status = stub_->StreamSynchronize(&context, request, &response);
+  if (!status.ok()) {
+    std::cerr << "RPC StreamSynchronize Failed!\n\t" << status.error_message()
+              << "\n";
+  }
+  return to_result(status);
+}
+
+CUresult CudaDriverClient::StreamWaitEvent(uint64_t stream, uint64_t event) {
+  EventStream request;
+  request.mutable_event()->set_handle(event);
+  request.mutable_stream()->set_handle(stream);
+  launcher_->push([stub = stub_.get(), request] {
+    ClientContext context;
+    Empty response;
+    Status status = stub->StreamWaitEvent(&context, request, &response);
+    if (!status.ok()) {
+      std::cerr << "RPC StreamWaitEvent Failed!\n\t" << status.error_message()
+                << "\n";
+    }
+    return status;
+  });
+  return CUDA_SUCCESS;
+}
+
+CUresult CudaDriverClient::EventCreate(uint64_t *event) {
+  ClientContext context;
+  Empty request;
+  Event response;
+  Status status = stub_->EventCreate(&context, request, &response);
+  if (!status.ok()) {
+    std::cerr << "RPC EventCreate Failed!\n\t" << status.error_message()
+              << "\n";
+  }
+  *event = response.handle();
+  return to_result(status);
+}
+
+CUresult CudaDriverClient::EventDestroy(uint64_t event) {
+  // Records and waits still queued here may use it
+  if (auto result = flush(); result != CUDA_SUCCESS) return result;
+
+  ClientContext context;
+  Event request;
+  Empty response;
+  request.set_handle(event);
+  Status status = stub_->EventDestroy(&context, request, &response);
+  if (!status.ok()) {
+    std::cerr << "RPC EventDestroy Failed!\n\t" << status.error_message()
+              << "\n";
+  }
+  return to_result(status);
+}
+
+CUresult CudaDriverClient::EventRecord(uint64_t event, uint64_t stream) {
+  EventStream request;
+  request.mutable_event()->set_handle(event);
+  request.mutable_stream()->set_handle(stream);
+  launcher_->push([stub = stub_.get(), request] {
+    ClientContext context;
+    Empty response;
+    Status status = stub->EventRecord(&context, request, &response);
+    if (!status.ok()) {
+      std::cerr << "RPC EventRecord Failed!\n\t" << status.error_message()
+                << "\n";
+    }
+    return status;
+  });
+  return CUDA_SUCCESS;
+}
+
+CUresult CudaDriverClient::EventQuery(uint64_t event) {
+  if (auto result = flush(); result != CUDA_SUCCESS) return result;
+
+  ClientContext context;
+  Event request;
+  Empty response;
+  request.set_handle(event);
+  Status status = stub_->EventQuery(&context, request, &response);
+  if (!status.ok() &&
+      status.error_code() != grpc::StatusCode::FAILED_PRECONDITION) {
+    std::cerr << "RPC EventQuery Failed!\n\t" << status.error_message()
+              << "\n";
   }
+  return to_result(status);
+}
+
+CUresult CudaDriverClient::EventSynchronize(uint64_t event) {
+  if (auto result = flush(); result != CUDA_SUCCESS) return result;
 
-  Status status = stub_->LaunchKernel(&context, request, &response);
+  ClientContext context;
+  Event request;
+  Empty response;
+  request.set_handle(event);
+  Status status = stub_->EventSynchronize(&context, request, &response);
   if (!status.ok()) {
-    std::cerr << "RPC LaunchKernel Failed!\n\t" << status.error_message()
+    std::cerr << "RPC EventSynchronize Failed!\n\t" << status.error_message()
+              << "\n";
+  }
+  return to_result(status);
+}
+
+CUresult CudaDriverClient::EventElapsedTime(float *milliseconds,
+                                            uint64_t start, uint64_t end) {
+  if (auto result = flush(); result != CUDA_SUCCESS) return result;
+
+  ClientContext context;
+  EventPair request;
+  ElapsedTime response;
+  request.mutable_start()->set_handle(start);
+  request.mutable_end()->set_handle(end);
+  Status status = stub_->EventElapsedTime(&context, request, &response);
+  if (!status.ok() &&
+      status.error_code() != grpc::StatusCode::FAILED_PRECONDITION) {
+    std::cerr << "RPC EventElapsedTime Failed!\n\t" << status.error_message()
               << "\n";
   }
+  *milliseconds = response.milliseconds();
+  return to_result(status);
 }
 
 }  // namespace weft
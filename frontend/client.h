@@ -9,35 +9,69 @@
 #include <string_view>
 #include <vector>
 
-#include "nvrtc/kernel_parser.h"
+#include "kernel_metadata.h"
 #include "weft.grpc.pb.h"
 
 namespace weft {
 
+// Launches, event records and stream waits are sent in order from a
+// background thread and return at once.
+// Memory operations and Synchronize wait for them, and report a failed launch
+// since the last of these the way the driver reports asynchronous errors.
 class CudaDriverClient {
  public:
-  CudaDriverClient() {}
-  CudaDriverClient(std::shared_ptr<grpc::Channel> channel)
-      : stub_{CudaDriver::NewStub(channel)} {}
+  CudaDriverClient();
+  CudaDriverClient(std::shared_ptr<grpc::Channel> channel);
+  ~CudaDriverClient();
+
+  CudaDriverClient(CudaDriverClient &&) noexcept;
+  CudaDriverClient &operator=(CudaDriverClient &&) noexcept;
 
   uint64_t MemAlloc(size_t size);
-  void MemFree(uint64_t dptr);
-  void MemcpyHtoD(uint64_t dptr, std::string_view src);
-  void MemcpyDtoH(void *dst, uint64_t sptr, size_t size);
+  CUresult MemFree(uint64_t dptr);
+  CUresult MemcpyHtoD(uint64_t dptr, std::string_view src);
+  CUresult MemcpyDtoH(void *dst, uint64_t sptr, size_t size);
 
   uint64_t ModuleGetFunction(uint64_t hmod, std::string name,
-                             const std::vector<weft::nvrtc::Param> &params);
-  uint64_t ModuleLoadData(std::string image);
+                             const std::vector<Param> &params);
+  uint64_t ModuleLoadData(const Image &image);
 
   void LaunchKernel(uint64_t f, uint32_t gridDimX, uint32_t gridDimY,
                     uint32_t gridDimZ, uint32_t blockDimX, uint32_t blockDimY,
                     uint32_t blockDimZ, uint32_t sharedMemBytes,
                     uint64_t hStream,
-                    const std::vector<weft::nvrtc::Param> &metadata,
+                    const std::vector<Param> &metadata,
                     void *kernelParams[]);
+  CUresult Synchronize();
+
+  CUresult StreamCreate(uint64_t *stream);
+  CUresult StreamDestroy(uint64_t stream);
+  CUresult StreamSynchronize(uint64_t stream);
+  // Queued with the launches, like EventRecord
+  CUresult StreamWaitEvent(uint64_t stream, uint64_t event);
+
+  CUresult EventCreate(uint64_t *event);
+  CUresult EventDestroy(uint64_t event);
+  CUresult EventRecord(uint64_t event, uint64_t stream);
+  // CUDA_ERROR_NOT_READY while the work before the record is running
+  CUresult EventQuery(uint64_t event);
+  CUresult EventSynchronize(uint64_t event);
+  CUresult EventElapsedTime(float *milliseconds, uint64_t start,
+                            uint64_t end);
 
  private:
   std::unique_ptr<CudaDriver::Stub> stub_;
+
+  // Ends after the launcher has sent what is queued
+  class Session;
+  std::unique_ptr<Session> session_;
+
+  class Launcher;
+  std::unique_ptr<Launcher> launcher_;
+
+  // Waits until the server has queued every launch, with the first failure
+  // to send one
+  CUresult flush();
 };
 
 }  // namespace weft
@@ -0,0 +1,256 @@
+#include "kernel_metadata.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "ptx/entry_parser.h"
+#include "weft/cache.h"
+#include "weft/hash.h"
+
+namespace weft {
+
+// Bumped whenever the stored format or the Param fields change
+constexpr std::string_view metadata_format = "weft-metadata 3";
+
+static const char* access_name(Access access) {
+  switch (access) {
+    case Access::read_only:
+      return "read-only";
+    case Access::write_only:
+      return "write-only";
+    case Access::unused:
+      return "unused";
+    default:
+      return "read-write";
+  }
+}
+
+static const char* combine_name(Combine combine) {
+  switch (combine) {
+    case Combine::sum:
+      return "sum";
+    case Combine::min:
+      return "min";
+    case Combine::max:
+      return "max";
+    case Combine::bit_or:
+      return "or";
+    default:
+      return "none";
+  }
+}
+
+std::shared_ptr<std::vector<Param>> KernelMetadata::find(
+    uint64_t module, const std::string& name) const {
+  std::vector<std::shared_future<void>> pending;
+  {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    pending = pending_;
+  }
+  if (!pending.empty()) {
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& parse : pending) parse.wait();
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (elapsed.count() >= 1) {
+      std::clog << "> Metadata: waited " << elapsed.count()
+                << " ms for source parsing\n";
+    }
+
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    pending_.erase(std::remove_if(pending_.begin(), pending_.end(),
+                                  [](const auto& parse) {
+                                    return parse.wait_for(std::chrono::seconds(
+                                               0)) == std::future_status::ready;
+                                  }),
+                   pending_.end());
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto lookup = [&](const metadata_t<std::string>& signatures) {
+    auto it = signatures.find(name);
+    return it == signatures.end() ? nullptr : it->second;
+  };
+  if (auto source = module_sources_.find(module);
+      source != module_sources_.end()) {
+    if (auto it = sources_.find(source->second); it != sources_.end()) {
+      if (auto params = lookup(it->second)) return params;
+    }
+  }
+  if (auto it = modules_.find(module); it != modules_.end()) {
+    if (auto params = lookup(it->second)) return params;
+  }
+  return lookup(metadata_);
+}
+
+void KernelMetadata::parse_async(std::function<void(KernelMetadata&)> parse) {
+  auto future = std::async(std::launch::async, std::move(parse),
+                           std::ref(*this))
+                    .share();
+  std::lock_guard<std::mutex> lock(pending_mutex_);
+  pending_.push_back(std::move(future));
+}
+
+void KernelMetadata::parse_ptx(uint64_t module, std::string_view ptx) {
+  auto entries = ptx::parse_entries(ptx);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& signatures = modules_[module];
+  for (auto& entry : entries) {
+    auto params =
+        std::make_shared<std::vector<Param>>(std::move(entry.params));
+    metadata_[entry.name] = params;
+    signatures[std::move(entry.name)] = std::move(params);
+  }
+}
+
+void KernelMetadata::set_source(uint64_t module, std::string source_key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  module_sources_[module] = std::move(source_key);
+}
+
+void KernelMetadata::add(const std::string& source_key, std::string name,
+                         std::shared_ptr<std::vector<Param>> params) {
+  metadata_[name] = params;
+  sources_[source_key][std::move(name)] = std::move(params);
+}
+
+void KernelMetadata::add_source(const std::string& source_key,
+                                const KernelMetadata& parsed,
+                                const std::vector<std::string>& names) {
+  std::scoped_lock lock(mutex_, parsed.mutex_);
+  auto& signatures = sources_[source_key];
+  signatures.clear();
+  for (const auto& name : names) {
+    if (auto it = parsed.metadata_.find(name); it != parsed.metadata_.end()) {
+      add(source_key, name, it->second);
+    }
+  }
+}
+
+Param* KernelMetadata::own_pointer_param(uint64_t function_handle,
+                                         size_t param) {
+  auto it = metadata_handle_.find(function_handle);
+  if (it == metadata_handle_.end() || param >= it->second->size() ||
+      !(*it->second)[param].is_pointer()) {
+    return nullptr;
+  }
+
+  // The signature is shared by every function of that name, so the handle
+  // gets its own copy
+  it->second = std::make_shared<std::vector<Param>>(*it->second);
+  return &(*it->second)[param];
+}
+
+bool KernelMetadata::set_combine(uint64_t function_handle, size_t param,
+                                 Combine combine, Element element) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto* own = own_pointer_param(function_handle, param);
+  if (own) own->set_combine(combine, element);
+  return own;
+}
+
+bool KernelMetadata::set_elementwise(uint64_t function_handle, size_t param) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto* own = own_pointer_param(function_handle, param);
+  if (own) own->set_elementwise(true);
+  return own;
+}
+
+static std::string metadata_key(const std::string& source_key) {
+  return to_hex(source_key) + ".metadata";
+}
+
+static std::vector<std::string> split(const std::string& line) {
+  std::vector<std::string> fields;
+  std::istringstream stream(line);
+  for (std::string field; std::getline(stream, field, '\t');) {
+    fields.push_back(std::move(field));
+  }
+  return fields;
+}
+
+bool KernelMetadata::load(const std::string& source_key) {
+  auto data = cache::load(metadata_key(source_key));
+  if (!data) return false;
+
+  std::istringstream lines(*data);
+  std::string line;
+  if (!std::getline(lines, line) || line != metadata_format) return false;
+
+  auto number = [](const std::string& field) {
+    return std::strtoull(field.c_str(), nullptr, 10);
+  };
+  std::vector<std::pair<std::string, std::vector<Param>>> kernels;
+  while (std::getline(lines, line)) {
+    auto fields = split(line);
+    if (fields.size() == 2 && fields[0] == "kernel") {
+      kernels.emplace_back(std::move(fields[1]), std::vector<Param>{});
+    } else if (fields.size() == 12 && fields[0] == "param" &&
+               !kernels.empty()) {
+      auto& param = kernels.back().second.emplace_back(
+          std::move(fields[1]), std::move(fields[2]), number(fields[3]),
+          number(fields[4]), fields[5] == "1", fields[6] == "1",
+          static_cast<Access>(number(fields[7])), number(fields[8]));
+      param.set_combine(static_cast<Combine>(number(fields[9])),
+                        static_cast<Element>(number(fields[10])));
+      param.set_elementwise(fields[11] == "1");
+    } else {
+      return false;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  sources_[source_key].clear();
+  for (auto& kernel : kernels) {
+    add(source_key, std::move(kernel.first),
+        std::make_shared<std::vector<Param>>(std::move(kernel.second)));
+  }
+  return true;
+}
+
+void KernelMetadata::store(const std::string& source_key) const {
+  std::ostringstream data;
+  data << metadata_format << "\n";
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = sources_.find(source_key);
+  if (it == sources_.end()) return;
+  for (const auto& [name, params] : it->second) {
+    data << "kernel\t" << name << "\n";
+    for (const auto& param : *params) {
+      data << "param\t" << param.qualified_name() << "\t" << param.type()
+           << "\t" << param.size() << "\t" << param.pointee_size() << "\t"
+           << param.is_pointer() << "\t" << param.is_const() << "\t"
+           << static_cast<int>(param.access()) << "\t" << param.align() << "\t"
+           << static_cast<int>(param.combine()) << "\t"
+           << static_cast<int>(param.element()) << "\t"
+           << param.elementwise() << "\n";
+    }
+  }
+  cache::store(metadata_key(source_key), data.str());
+}
+
+std::ostream& operator<<(std::ostream& os, const Param& param) {
+  os << param.qualified_name_ << " - " << param.type_
+     << ", size: " << param.size_ << ", pointer: " << param.is_pointer_
+     << ", const: " << param.is_const_;
+  if (param.is_pointer_) os << ", " << access_name(param.access_);
+  if (param.combine_ != Combine::none) {
+    os << ", combine: " << combine_name(param.combine_);
+  }
+  if (param.elementwise_) os << ", elementwise";
+  return os;
+}
+
+}  // namespace weft
@@ -0,0 +1,166 @@
+#ifndef WEFT_FRONTEND_KERNEL_METADATA_H
+#define WEFT_FRONTEND_KERNEL_METADATA_H
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace weft {
+
+// How a kernel uses the memory behind a pointer parameter
+enum class Access { read_write, read_only, write_only, unused };
+
+// How a kernel accumulates into the memory behind a pointer parameter, e.g. a
+// sum with atomicAdd, so launches split across devices can merge their parts.
+// Values match weft_combine in weft/combine.h.
+enum class Combine { none, sum, min, max, bit_or };
+
+// Type of the elements combined
+enum class Element { unknown, int32, uint32, float32, int64, uint64, float64 };
+
+class Param {
+ public:
+  Param(std::string qualified_name, std::string type, size_t size,
+        size_t pointee_size, bool is_pointer, bool is_const,
+        Access access = Access::read_write, size_t align = 0)
+      : qualified_name_{std::move(qualified_name)},
+        type_{std::move(type)},
+        size_{size},
+        pointee_size_{pointee_size},
+        align_{align},
+        is_pointer_{is_pointer},
+        is_const_{is_const},
+        access_{access} {}
+
+  const std::string& qualified_name() const noexcept { return qualified_name_; }
+  const std::string& type() const noexcept { return type_; }
+  constexpr size_t size() const noexcept { return size_; }
+  constexpr size_t pointee_size() const noexcept { return pointee_size_; }
+  constexpr size_t align() const noexcept { return align_; }
+  constexpr bool is_pointer() const noexcept { return is_pointer_; }
+  constexpr bool is_const() const noexcept { return is_const_; }
+  constexpr Access access() const noexcept { return access_; }
+  constexpr Combine combine() const noexcept { return combine_; }
+  constexpr Element element() const noexcept { return element_; }
+  // Thread i of a 1-D launch only uses element i behind the pointer
+  constexpr bool elementwise() const noexcept { return elementwise_; }
+
+  void set_combine(Combine combine, Element element) noexcept {
+    combine_ = combine;
+    element_ = element;
+  }
+  void set_elementwise(bool elementwise) noexcept {
+    elementwise_ = elementwise;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const Param& param);
+
+ private:
+  std::string qualified_name_;
+  std::string type_;
+  size_t size_;
+  size_t pointee_size_;  // 0 if unknown
+  size_t align_;         // 0 if unknown
+  bool is_pointer_;
+  bool is_const_;
+  Access access_;
+  Combine combine_ = Combine::none;
+  Element element_ = Element::unknown;
+  bool elementwise_ = false;
+};
+
+template <typename T>
+using metadata_t = std::unordered_map<T, std::shared_ptr<std::vector<Param>>>;
+
+// Kernel signatures by module and by function handle. They come from PTX
+// .entry declarations of loaded modules or, when built with clang, from parsing
+// the sources given to NVRTC, which also knows constness and access. Sources
+// are parsed in the background; only find() waits for them.
+class KernelMetadata {
+ public:
+  // Whether a signature is known by name, without waiting for background parses
+  bool contains(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return metadata_.count(name) != 0;
+  }
+
+  // Signature of a module's kernel once all background parses are done, null
+  // if there is none. The module's own source comes first, then its PTX. The
+  // latest signature of that name from any source or module only stands in
+  // for images that have neither, e.g. cubins.
+  std::shared_ptr<std::vector<Param>> find(uint64_t module,
+                                           const std::string& name) const;
+
+  std::shared_ptr<std::vector<Param>> at(uint64_t handle) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return metadata_handle_.at(handle);
+  }
+
+  auto emplace(uint64_t function_handle,
+               const std::shared_ptr<std::vector<Param>>& vec_ptr) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return metadata_handle_.emplace(function_handle, vec_ptr);
+  }
+
+  // Sets how a function combines into a pointer parameter, for this function
+  // handle only. False if the handle is unknown or the parameter is not a
+  // pointer.
+  bool set_combine(uint64_t function_handle, size_t param, Combine combine,
+                   Element element);
+  // Declares a pointer parameter elementwise, likewise
+  bool set_elementwise(uint64_t function_handle, size_t param);
+
+  // Used by parse_cu, into a KernelMetadata of its own, see add_source()
+  void set(std::string name, std::vector<Param> params) {
+    auto vec_ptr = std::make_shared<std::vector<Param>>(std::move(params));
+    std::lock_guard<std::mutex> lock(mutex_);
+    metadata_[std::move(name)] = std::move(vec_ptr);
+  }
+
+  // Runs a parse on its own thread, e.g. overlapped with NVRTC compiling the
+  // same source
+  void parse_async(std::function<void(KernelMetadata&)> parse);
+
+  // Adds the kernels of a loaded PTX module
+  void parse_ptx(uint64_t module, std::string_view ptx);
+  // The module was loaded from the NVRTC output of the source with this key
+  void set_source(uint64_t module, std::string source_key);
+
+  // Takes the named kernels that parse_cu set in `parsed` as the signatures of
+  // the source with this key, a SHA-256 of the source and parser version
+  void add_source(const std::string& source_key, const KernelMetadata& parsed,
+                  const std::vector<std::string>& names);
+  // Signatures of a source kept on disk by store(), e.g. in an earlier run,
+  // so repeat runs need not parse it again. False if there are none.
+  bool load(const std::string& source_key);
+  void store(const std::string& source_key) const;
+
+ private:
+  mutable std::mutex mutex_;
+  metadata_t<std::string> metadata_;  // latest by name
+  std::unordered_map<std::string, metadata_t<std::string>> sources_;
+  std::unordered_map<uint64_t, metadata_t<std::string>> modules_;  // from PTX
+  std::unordered_map<uint64_t, std::string> module_sources_;
+  metadata_t<uint64_t> metadata_handle_;
+
+  // Called with mutex_ held
+  void add(const std::string& source_key, std::string name,
+           std::shared_ptr<std::vector<Param>> params);
+  // Called with mutex_ held. The pointer parameter in the function handle's
+  // own copy of its signature, null if there is none.
+  Param* own_pointer_param(uint64_t function_handle, size_t param);
+
+  mutable std::mutex pending_mutex_;
+  mutable std::vector<std::shared_future<void>> pending_;
+};
+
+}  // namespace weft
+
+#endif  // WEFT_FRONTEND_KERNEL_METADATA_H
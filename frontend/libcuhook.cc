@@ -117,6 +117,39 @@ struct cuHookInfo {
       fprintf(stderr, "* %6d >> %20s ... %d\n", pid,
               CUDA_SYMBOL_STRING(cuCtxDestroy),
               hookedFunctionCalls[CU_HOOK_CTX_DESTROY]);
+      fprintf(stderr, "* %6d >> %20s ... %d\n", pid,
+              CUDA_SYMBOL_STRING(cuCtxSynchronize),
+              hookedFunctionCalls[CU_HOOK_CTX_SYNCHRONIZE]);
+      fprintf(stderr, "* %6d >> %20s ... %d\n", pid,
+              CUDA_SYMBOL_STRING(cuStreamCreate),
+              hookedFunctionCalls[CU_HOOK_STREAM_CREATE]);
+      fprintf(stderr, "* %6d >> %20s ... %d\n", pid,
+              CUDA_SYMBOL_STRING(cuStreamDestroy),
+              hookedFunctionCalls[CU_HOOK_STREAM_DESTROY]);
+      fprintf(stderr, "* %6d >> %20s ... %d\n", pid,
+              CUDA_SYMBOL_STRING(cuStreamSynchronize),
+              hookedFunctionCalls[CU_HOOK_STREAM_SYNCHRONIZE]);
+      fprintf(stderr, "* %6d >> %20s ... %d\n", pid,
+              CUDA_SYMBOL_STRING(cuStreamWaitEvent),
+              hookedFunctionCalls[CU_HOOK_STREAM_WAIT_EVENT]);
+      fprintf(stderr, "* %6d >> %20s ... %d\n", pid,
+              CUDA_SYMBOL_STRING(cuEventCreate),
+              hookedFunctionCalls[CU_HOOK_EVENT_CREATE]);
+      fprintf(stderr, "* %6d >> %20s ... %d\n", pid,
+              CUDA_SYMBOL_STRING(cuEventDestroy),
+              hookedFunctionCalls[CU_HOOK_EVENT_DESTROY]);
+      fprintf(stderr, "* %6d >> %20s ... %d\n", pid,
+              CUDA_SYMBOL_STRING(cuEventRecord),
+              hookedFunctionCalls[CU_HOOK_EVENT_RECORD]);
+      fprintf(stderr, "* %6d >> %20s ... %d\n", pid,
+              CUDA_SYMBOL_STRING(cuEventQuery),
+              hookedFunctionCalls[CU_HOOK_EVENT_QUERY]);
+      fprintf(stderr, "* %6d >> %20s ... %d\n", pid,
+              CUDA_SYMBOL_STRING(cuEventSynchronize),
+              hookedFunctionCalls[CU_HOOK_EVENT_SYNCHRONIZE]);
+      fprintf(stderr, "* %6d >> %20s ... %d\n", pid,
+              CUDA_SYMBOL_STRING(cuEventElapsedTime),
+              hookedFunctionCalls[CU_HOOK_EVENT_ELAPSED_TIME]);
       fprintf(stderr, "* %6d >> %20s ... %d\n", pid,
               CUDA_SYMBOL_STRING(cuLaunchKernel),
               hookedFunctionCalls[CU_HOOK_LAUNCH_KERNEL]);
@@ -166,6 +199,28 @@ void *dlsym(void *handle, const char *symbol) {
     return (void *)(&cuCtxSetCurrent);
   } else if (strcmp(symbol, CUDA_SYMBOL_STRING(cuCtxDestroy)) == 0) {
     return (void *)(&cuCtxDestroy);
+  } else if (strcmp(symbol, CUDA_SYMBOL_STRING(cuCtxSynchronize)) == 0) {
+    return (void *)(&cuCtxSynchronize);
+  } else if (strcmp(symbol, CUDA_SYMBOL_STRING(cuStreamCreate)) == 0) {
+    return (void *)(&cuStreamCreate);
+  } else if (strcmp(symbol, CUDA_SYMBOL_STRING(cuStreamDestroy)) == 0) {
+    return (void *)(&cuStreamDestroy);
+  } else if (strcmp(symbol, CUDA_SYMBOL_STRING(cuStreamSynchronize)) == 0) {
+    return (void *)(&cuStreamSynchronize);
+  } else if (strcmp(symbol, CUDA_SYMBOL_STRING(cuStreamWaitEvent)) == 0) {
+    return (void *)(&cuStreamWaitEvent);
+  } else if (strcmp(symbol, CUDA_SYMBOL_STRING(cuEventCreate)) == 0) {
+    return (void *)(&cuEventCreate);
+  } else if (strcmp(symbol, CUDA_SYMBOL_STRING(cuEventDestroy)) == 0) {
+    return (void *)(&cuEventDestroy);
+  } else if (strcmp(symbol, CUDA_SYMBOL_STRING(cuEventRecord)) == 0) {
+    return (void *)(&cuEventRecord);
+  } else if (strcmp(symbol, CUDA_SYMBOL_STRING(cuEventQuery)) == 0) {
+    return (void *)(&cuEventQuery);
+  } else if (strcmp(symbol, CUDA_SYMBOL_STRING(cuEventSynchronize)) == 0) {
+    return (void *)(&cuEventSynchronize);
+  } else if (strcmp(symbol, CUDA_SYMBOL_STRING(cuEventElapsedTime)) == 0) {
+    return (void *)(&cuEventElapsedTime);
   } else if (strcmp(symbol, CUDA_SYMBOL_STRING(cuModuleGetFunction)) == 0) {
     return (void *)(&cuModuleGetFunction);
   } else if (strcmp(symbol, CUDA_SYMBOL_STRING(cuModuleLoadDataEx)) == 0) {
@@ -227,6 +282,33 @@ CU_HOOK_GENERATE_INTERCEPT(CU_HOOK_CTX_SET_CURRENT, cuCtxSetCurrent,
                            (CUcontext ctx), ctx)
 CU_HOOK_GENERATE_INTERCEPT(CU_HOOK_CTX_DESTROY, cuCtxDestroy, (CUcontext ctx),
                            ctx)
+CU_HOOK_GENERATE_INTERCEPT(CU_HOOK_CTX_SYNCHRONIZE, cuCtxSynchronize, (void))
+CU_HOOK_GENERATE_INTERCEPT(CU_HOOK_STREAM_CREATE, cuStreamCreate,
+                           (CUstream * phStream, unsigned int Flags), phStream,
+                           Flags)
+CU_HOOK_GENERATE_INTERCEPT(CU_HOOK_STREAM_DESTROY, cuStreamDestroy,
+                           (CUstream hStream), hStream)
+CU_HOOK_GENERATE_INTERCEPT(CU_HOOK_STREAM_SYNCHRONIZE, cuStreamSynchronize,
+                           (CUstream hStream), hStream)
+CU_HOOK_GENERATE_INTERCEPT(CU_HOOK_STREAM_WAIT_EVENT, cuStreamWaitEvent,
+                           (CUstream hStream, CUevent hEvent,
+                            unsigned int Flags),
+                           hStream, hEvent, Flags)
+CU_HOOK_GENERATE_INTERCEPT(CU_HOOK_EVENT_CREATE, cuEventCreate,
+                           (CUevent * phEvent, unsigned int Flags), phEvent,
+                           Flags)
+CU_HOOK_GENERATE_INTERCEPT(CU_HOOK_EVENT_DESTROY, cuEventDestroy,
+                           (CUevent hEvent), hEvent)
+CU_HOOK_GENERATE_INTERCEPT(CU_HOOK_EVENT_RECORD, cuEventRecord,
+                           (CUevent hEvent, CUstream hStream), hEvent, hStream)
+CU_HOOK_GENERATE_INTERCEPT(CU_HOOK_EVENT_QUERY, cuEventQuery, (CUevent hEvent),
+                           hEvent)
+CU_HOOK_GENERATE_INTERCEPT(CU_HOOK_EVENT_SYNCHRONIZE, cuEventSynchronize,
+                           (CUevent hEvent), hEvent)
+CU_HOOK_GENERATE_INTERCEPT(CU_HOOK_EVENT_ELAPSED_TIME, cuEventElapsedTime,
+                           (float *pMilliseconds, CUevent hStart,
+                            CUevent hEnd),
+                           pMilliseconds, hStart, hEnd)
 CU_HOOK_GENERATE_INTERCEPT(CU_HOOK_MODULE_GET_FUNCTION, cuModuleGetFunction,
                            (CUfunction * hfunc, CUmodule hmod,
                             const char *name),
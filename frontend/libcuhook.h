@@ -18,6 +18,17 @@ typedef enum CuHookSymbolsEnum {
   CU_HOOK_CTX_GET_CURRENT,
   CU_HOOK_CTX_SET_CURRENT,
   CU_HOOK_CTX_DESTROY,
+  CU_HOOK_CTX_SYNCHRONIZE,
+  CU_HOOK_STREAM_CREATE,
+  CU_HOOK_STREAM_DESTROY,
+  CU_HOOK_STREAM_SYNCHRONIZE,
+  CU_HOOK_STREAM_WAIT_EVENT,
+  CU_HOOK_EVENT_CREATE,
+  CU_HOOK_EVENT_DESTROY,
+  CU_HOOK_EVENT_RECORD,
+  CU_HOOK_EVENT_QUERY,
+  CU_HOOK_EVENT_SYNCHRONIZE,
+  CU_HOOK_EVENT_ELAPSED_TIME,
   CU_HOOK_MODULE_GET_FUNCTION,
   CU_HOOK_MODULE_LOAD_DATA_EX,
   CU_HOOK_LAUNCH_KERNEL,
@@ -48,6 +59,23 @@ typedef CUresult CUDAAPI (*fnMemcpyDtoH)(void *dstHost, CUdeviceptr srcDevice,
 typedef CUresult CUDAAPI (*fnCtxGetCurrent)(CUcontext *pctx);
 typedef CUresult CUDAAPI (*fnCtxSetCurrent)(CUcontext ctx);
 typedef CUresult CUDAAPI (*fnCtxDestroy)(CUcontext ctx);
+typedef CUresult CUDAAPI (*fnCtxSynchronize)(void);
+typedef CUresult CUDAAPI (*fnStreamCreate)(CUstream *phStream,
+                                           unsigned int Flags);
+typedef CUresult CUDAAPI (*fnStreamDestroy)(CUstream hStream);
+typedef CUresult CUDAAPI (*fnStreamSynchronize)(CUstream hStream);
+typedef CUresult CUDAAPI (*fnStreamWaitEvent)(CUstream hStream,
+                                              CUevent hEvent,
+                                              unsigned int Flags);
+
+typedef CUresult CUDAAPI (*fnEventCreate)(CUevent *phEvent,
+                                          unsigned int Flags);
+typedef CUresult CUDAAPI (*fnEventDestroy)(CUevent hEvent);
+typedef CUresult CUDAAPI (*fnEventRecord)(CUevent hEvent, CUstream hStream);
+typedef CUresult CUDAAPI (*fnEventQuery)(CUevent hEvent);
+typedef CUresult CUDAAPI (*fnEventSynchronize)(CUevent hEvent);
+typedef CUresult CUDAAPI (*fnEventElapsedTime)(float *pMilliseconds,
+                                               CUevent hStart, CUevent hEnd);
 
 typedef CUresult CUDAAPI (*fnModuleLoadDataEx)(CUmodule *module,
                                                const void *image,
@@ -8,13 +8,26 @@
 #include <stdio.h>
 #include <unistd.h>
 
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <optional>
+#include <string>
 #include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "client.h"
+#include "kernel_metadata.h"
 #include "libcuhook.h"
-#include "nvrtc/kernel_parser.h"
+#include "module_image.h"
+#include "nvrtc/plugin.h"
+#include "weft/combine.h"
+#include "weft/hash.h"
+#include "weft/pipeline.h"
 
 // Helper function to run initialization steps
 #define ASSERT_COND(x, msg)                                                    \
@@ -28,9 +41,35 @@
   } while (0)
 
 static weft::CudaDriverClient client;
-static weft::nvrtc::KernelMetadata metadata;
+static weft::KernelMetadata metadata;
 static bool weftInitialized = false;
 
+// NVRTC programs seen by the app, so a module loaded from a program's PTX takes
+// the kernel signatures parsed from its source. With WEFT_REMOTE_NVRTC set, the
+// module is sent as source instead and compiled by the server for each
+// device's exact architecture ("specialize" also bakes in scalar launch
+// arguments that never change). PTX buffers are kept with their contents, in
+// case the app reuses one for other PTX, until a module is loaded from them.
+struct Program {
+  std::string source_key;  // of its kernel metadata
+  std::optional<weft::Image> image;
+};
+static std::unordered_map<nvrtcProgram, Program> programs;
+static std::unordered_map<const void *, std::pair<std::string, Program>>
+    program_ptx;
+
+// Client streams are server stream handles, which start above the legacy and
+// per-thread default streams; those are the server's default stream, 0
+static uint64_t stream_handle(CUstream hStream) {
+  if (hStream == CU_STREAM_LEGACY || hStream == CU_STREAM_PER_THREAD) return 0;
+  return reinterpret_cast<uint64_t>(hStream);
+}
+
+static const char *remote_nvrtc() {
+  static const char *mode = std::getenv("WEFT_REMOTE_NVRTC");
+  return mode;
+}
+
 CUresult MemAlloc_intercept(CUdeviceptr *dptr, size_t bytesize) {
   std::clog << "* " << std::setw(6) << getpid()
             << " >> Received cuMemAlloc! Loc: " << dptr << " for " << bytesize
@@ -44,8 +83,7 @@ CUresult MemAlloc_intercept(CUdeviceptr *dptr, size_t bytesize) {
 CUresult MemFree_intercept(CUdeviceptr dptr) {
   std::clog << "* " << std::setw(6) << getpid()
             << " >> Received cuMemFree! Handle: " << dptr << "\n";
-  client.MemFree(dptr);
-  return CUDA_SUCCESS;
+  return client.MemFree(dptr);
 }
 
 CUresult MemcpyHtoD_intercept(CUdeviceptr dstDevice, const void *srcHost,
@@ -54,8 +92,7 @@ CUresult MemcpyHtoD_intercept(CUdeviceptr dstDevice, const void *srcHost,
             << " >> Received cuMemcpyHtoD! Handle: " << dstDevice
             << " from: " << srcHost << " for " << ByteCount << "\n";
   std::string_view srcHostView(static_cast<const char *>(srcHost), ByteCount);
-  client.MemcpyHtoD(dstDevice, srcHostView);
-  return CUDA_SUCCESS;
+  return client.MemcpyHtoD(dstDevice, srcHostView);
 }
 
 CUresult MemcpyDtoH_intercept(void *dstHost, CUdeviceptr srcDevice,
@@ -64,8 +101,7 @@ CUresult MemcpyDtoH_intercept(void *dstHost, CUdeviceptr srcDevice,
             << " >> Received cuMemcpyDtoH! Dest: " << dstHost
             << " from: " << srcDevice << " for " << ByteCount << "\n";
   // FIXME: Can we do a zero-copy with return semantics?
-  client.MemcpyDtoH(dstHost, srcDevice, ByteCount);
-  return CUDA_SUCCESS;
+  return client.MemcpyDtoH(dstHost, srcDevice, ByteCount);
 }
 
 CUresult ModuleGetFunction_intercept(CUfunction *hfunc, CUmodule hmod,
@@ -75,11 +111,16 @@ CUresult ModuleGetFunction_intercept(CUfunction *hfunc, CUmodule hmod,
             << " >> Received cuModuleGetFunction!\n\tModule: " << m_handle
             << ", name: " << name << "\n";
 
-  auto f_handle = client.ModuleGetFunction(m_handle, name, *metadata.at(name));
+  auto params = metadata.find(m_handle, name);
+  if (!params) {
+    std::cerr << "Error: no signature for kernel " << name << "\n";
+    return CUDA_ERROR_NOT_FOUND;
+  }
+  auto f_handle = client.ModuleGetFunction(m_handle, name, *params);
 
   // FIXME: this cast is terrible...
   *hfunc = reinterpret_cast<CUfunction>(f_handle);
-  metadata.emplace(f_handle, metadata.at(name));
+  metadata.emplace(f_handle, params);
 
   std::clog << "\tAssociated with " << f_handle << "\n";
   return CUDA_SUCCESS;
@@ -88,14 +129,27 @@ CUresult ModuleGetFunction_intercept(CUfunction *hfunc, CUmodule hmod,
 CUresult ModuleLoadDataEx_intercept(CUmodule *module, const void *image,
                                     uint32_t numOptions, CUjit_option *options,
                                     void *optionValues[]) {
+  auto request = weft::make_image(image, numOptions, options, optionValues);
+  std::optional<std::string> ptx;
+  if (request.type() == weft::Image::PTX) ptx = request.data();
+  std::optional<Program> program;
+  if (auto it = program_ptx.find(image); it != program_ptx.end()) {
+    if (ptx && it->second.first == *ptx) program = std::move(it->second.second);
+    program_ptx.erase(it);
+  }
+  if (program && program->image) request = std::move(*program->image);
   std::clog << "* " << std::setw(6) << getpid()
-            << " >> Received cuModuleLoadDataEx!\n";
-  // TODO: Support non-string image (file/executable resource)
-  // TODO: Support options
+            << " >> Received cuModuleLoadDataEx!\n\tImage: "
+            << weft::Image::Type_Name(request.type()) << ", "
+            << request.data().size() << " bytes, "
+            << request.options_size() << " options\n";
+
+  auto m_handle = client.ModuleLoadData(request);
+  if (ptx) metadata.parse_ptx(m_handle, *ptx);
+  if (program) metadata.set_source(m_handle, std::move(program->source_key));
 
   // FIXME: this cast is also terrible...
-  *module = reinterpret_cast<CUmodule>(
-      client.ModuleLoadData(reinterpret_cast<const char *>(image)));
+  *module = reinterpret_cast<CUmodule>(m_handle);
   return CUDA_SUCCESS;
 }
 
@@ -116,18 +170,98 @@ CUresult LaunchKernel_intercept(CUfunction f, uint32_t gridDimX,
             << "\n";
 
   if (extra) {
-    // TODO: hStream also unsupported
     std::cerr << "Error: passing extra is unsupported!\n";
   }
 
   auto handle = reinterpret_cast<uint64_t>(f);
   client.LaunchKernel(handle, gridDimX, gridDimY, gridDimZ, blockDimX,
                       blockDimY, blockDimZ, sharedMemBytes,
-                      reinterpret_cast<uint64_t>(hStream), *metadata.at(handle),
+                      stream_handle(hStream), *metadata.at(handle),
                       kernelParams);
   return CUDA_SUCCESS;
 }
 
+// Launches are asynchronous, so these are where they are waited for and
+// where their failures surface
+CUresult CtxSynchronize_intercept() {
+  std::clog << "* " << std::setw(6) << getpid()
+            << " >> Received cuCtxSynchronize!\n";
+  return client.Synchronize();
+}
+
+CUresult StreamSynchronize_intercept(CUstream hStream) {
+  std::clog << "* " << std::setw(6) << getpid()
+            << " >> Received cuStreamSynchronize! Stream: " << hStream << "\n";
+  return client.StreamSynchronize(stream_handle(hStream));
+}
+
+// Flags are not needed: server streams only synchronize through events
+CUresult StreamCreate_intercept(CUstream *phStream, unsigned int Flags) {
+  uint64_t handle;
+  auto result = client.StreamCreate(&handle);
+  *phStream = reinterpret_cast<CUstream>(handle);
+  std::clog << "* " << std::setw(6) << getpid()
+            << " >> Received cuStreamCreate! Stream: " << *phStream << "\n";
+  return result;
+}
+
+CUresult StreamDestroy_intercept(CUstream hStream) {
+  std::clog << "* " << std::setw(6) << getpid()
+            << " >> Received cuStreamDestroy! Stream: " << hStream << "\n";
+  return client.StreamDestroy(stream_handle(hStream));
+}
+
+// Events are server event handles. Flags are not needed: the server's events
+// always record timing and block the waiting thread rather than spin.
+CUresult EventCreate_intercept(CUevent *phEvent, unsigned int Flags) {
+  uint64_t handle;
+  auto result = client.EventCreate(&handle);
+  *phEvent = reinterpret_cast<CUevent>(handle);
+  std::clog << "* " << std::setw(6) << getpid()
+            << " >> Received cuEventCreate! Event: " << *phEvent << "\n";
+  return result;
+}
+
+CUresult EventDestroy_intercept(CUevent hEvent) {
+  std::clog << "* " << std::setw(6) << getpid()
+            << " >> Received cuEventDestroy! Event: " << hEvent << "\n";
+  return client.EventDestroy(reinterpret_cast<uint64_t>(hEvent));
+}
+
+CUresult EventRecord_intercept(CUevent hEvent, CUstream hStream) {
+  std::clog << "* " << std::setw(6) << getpid()
+            << " >> Received cuEventRecord! Event: " << hEvent
+            << ", Stream: " << hStream << "\n";
+  return client.EventRecord(reinterpret_cast<uint64_t>(hEvent),
+                            stream_handle(hStream));
+}
+
+CUresult EventQuery_intercept(CUevent hEvent) {
+  return client.EventQuery(reinterpret_cast<uint64_t>(hEvent));
+}
+
+CUresult EventSynchronize_intercept(CUevent hEvent) {
+  std::clog << "* " << std::setw(6) << getpid()
+            << " >> Received cuEventSynchronize! Event: " << hEvent << "\n";
+  return client.EventSynchronize(reinterpret_cast<uint64_t>(hEvent));
+}
+
+CUresult EventElapsedTime_intercept(float *pMilliseconds, CUevent hStart,
+                                    CUevent hEnd) {
+  return client.EventElapsedTime(pMilliseconds,
+                                 reinterpret_cast<uint64_t>(hStart),
+                                 reinterpret_cast<uint64_t>(hEnd));
+}
+
+CUresult StreamWaitEvent_intercept(CUstream hStream, CUevent hEvent,
+                                   unsigned int Flags) {
+  std::clog << "* " << std::setw(6) << getpid()
+            << " >> Received cuStreamWaitEvent! Stream: " << hStream
+            << ", Event: " << hEvent << "\n";
+  return client.StreamWaitEvent(stream_handle(hStream),
+                                reinterpret_cast<uint64_t>(hEvent));
+}
+
 void weft_init() {
   // Load the cudaHookRegisterCallback symbol using the default library search
   // order. If we found the symbol, then the hooking library has been loaded
@@ -160,6 +294,28 @@ void weft_init() {
            reinterpret_cast<void *>(ModuleLoadDataEx_intercept));
     cuHook(CU_HOOK_LAUNCH_KERNEL, INTERCEPT_HOOK,
            reinterpret_cast<void *>(LaunchKernel_intercept));
+    cuHook(CU_HOOK_CTX_SYNCHRONIZE, INTERCEPT_HOOK,
+           reinterpret_cast<void *>(CtxSynchronize_intercept));
+    cuHook(CU_HOOK_STREAM_CREATE, INTERCEPT_HOOK,
+           reinterpret_cast<void *>(StreamCreate_intercept));
+    cuHook(CU_HOOK_STREAM_DESTROY, INTERCEPT_HOOK,
+           reinterpret_cast<void *>(StreamDestroy_intercept));
+    cuHook(CU_HOOK_STREAM_SYNCHRONIZE, INTERCEPT_HOOK,
+           reinterpret_cast<void *>(StreamSynchronize_intercept));
+    cuHook(CU_HOOK_STREAM_WAIT_EVENT, INTERCEPT_HOOK,
+           reinterpret_cast<void *>(StreamWaitEvent_intercept));
+    cuHook(CU_HOOK_EVENT_CREATE, INTERCEPT_HOOK,
+           reinterpret_cast<void *>(EventCreate_intercept));
+    cuHook(CU_HOOK_EVENT_DESTROY, INTERCEPT_HOOK,
+           reinterpret_cast<void *>(EventDestroy_intercept));
+    cuHook(CU_HOOK_EVENT_RECORD, INTERCEPT_HOOK,
+           reinterpret_cast<void *>(EventRecord_intercept));
+    cuHook(CU_HOOK_EVENT_QUERY, INTERCEPT_HOOK,
+           reinterpret_cast<void *>(EventQuery_intercept));
+    cuHook(CU_HOOK_EVENT_SYNCHRONIZE, INTERCEPT_HOOK,
+           reinterpret_cast<void *>(EventSynchronize_intercept));
+    cuHook(CU_HOOK_EVENT_ELAPSED_TIME, INTERCEPT_HOOK,
+           reinterpret_cast<void *>(EventElapsedTime_intercept));
     weftInitialized = true;
   }
 }
@@ -178,12 +334,124 @@ nvrtcResult nvrtcCreateProgram(nvrtcProgram *prog, const char *src,
                                const char *const *headers,
                                const char *const *includeNames) {
   std::clog << "nvrtcCreateProgram:\n";
-  metadata.parse_cu(src);
+  auto key = weft::Sha256()
+                 .update_field(weft::nvrtc::parser_version)
+                 .update(src)
+                 .digest();
+  // Overlaps the app's own NVRTC compile of the same source. Cache hits
+  // never load the clang plugin.
+  metadata.parse_async([src = std::string(src), key](auto &metadata) {
+    auto start = std::chrono::steady_clock::now();
+    bool cached = metadata.load(key);
+    if (!cached) {
+      auto parse_cu = weft::nvrtc::parse_cu_plugin();
+      if (!parse_cu) return;
+      weft::KernelMetadata parsed;
+      std::vector<std::string> names;
+      parse_cu(&src, &parsed, &names);
+      metadata.add_source(key, parsed, names);
+      metadata.store(key);
+    }
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::clog << "* " << std::setw(6) << getpid() << " >> Kernel metadata "
+              << (cached ? "loaded from cache" : "parsed") << " in "
+              << elapsed.count() << " ms\n";
+  });
 
   typedef nvrtcResult (*fnNvrtcCreateProgram)(
       nvrtcProgram *, const char *, const char *, int, const char *const *,
       const char *const *);
-  return reinterpret_cast<fnNvrtcCreateProgram>(
+  auto result = reinterpret_cast<fnNvrtcCreateProgram>(
       dlsym(RTLD_NEXT, "nvrtcCreateProgram"))(prog, src, name, numHeaders,
                                               headers, includeNames);
+
+  if (result != NVRTC_SUCCESS) return result;
+  auto &program = programs[*prog];
+  program = {std::move(key), std::nullopt};
+  if (remote_nvrtc()) {
+    auto &image = program.image.emplace();
+    image.set_type(weft::Image::CUDA);
+    image.set_data(src);
+    image.set_name(name ? name : "default_program");
+    for (int i = 0; i < numHeaders; ++i) {
+      auto header = image.add_headers();
+      header->set_name(includeNames[i]);
+      header->set_src(headers[i]);
+    }
+    image.set_specialize(std::strcmp(remote_nvrtc(), "specialize") == 0);
+  }
+  return result;
+}
+
+nvrtcResult nvrtcCompileProgram(nvrtcProgram prog, int numOptions,
+                                const char *const *options) {
+  if (auto it = programs.find(prog);
+      it != programs.end() && it->second.image) {
+    it->second.image->clear_compile_options();
+    for (int i = 0; i < numOptions; ++i) {
+      it->second.image->add_compile_options(options[i]);
+    }
+  }
+
+  typedef nvrtcResult (*fnNvrtcCompileProgram)(nvrtcProgram, int,
+                                               const char *const *);
+  return reinterpret_cast<fnNvrtcCompileProgram>(
+      dlsym(RTLD_NEXT, "nvrtcCompileProgram"))(prog, numOptions, options);
+}
+
+nvrtcResult nvrtcGetPTX(nvrtcProgram prog, char *ptx) {
+  typedef nvrtcResult (*fnNvrtcGetPTX)(nvrtcProgram, char *);
+  auto result = reinterpret_cast<fnNvrtcGetPTX>(
+      dlsym(RTLD_NEXT, "nvrtcGetPTX"))(prog, ptx);
+
+  if (auto it = programs.find(prog);
+      result == NVRTC_SUCCESS && it != programs.end()) {
+    program_ptx[ptx] = {ptx, it->second};
+  }
+  return result;
+}
+
+nvrtcResult nvrtcDestroyProgram(nvrtcProgram *prog) {
+  programs.erase(*prog);
+
+  typedef nvrtcResult (*fnNvrtcDestroyProgram)(nvrtcProgram *);
+  return reinterpret_cast<fnNvrtcDestroyProgram>(
+      dlsym(RTLD_NEXT, "nvrtcDestroyProgram"))(prog);
+}
+
+// API for applications, see weft/combine.h and weft/pipeline.h
+
+CUresult weftFuncSetCombine(CUfunction f, unsigned int param,
+                            weft_combine combine, weft_element element) {
+  std::clog << "* " << std::setw(6) << getpid()
+            << " >> Received weftFuncSetCombine! Function: " << f
+            << ", param: " << param << ", combine: " << combine
+            << ", element: " << element << "\n";
+
+  bool is_float =
+      element == WEFT_ELEMENT_FLOAT32 || element == WEFT_ELEMENT_FLOAT64;
+  if (combine < WEFT_COMBINE_NONE || combine > WEFT_COMBINE_OR ||
+      element < WEFT_ELEMENT_UNKNOWN || element > WEFT_ELEMENT_FLOAT64 ||
+      (combine != WEFT_COMBINE_NONE && element == WEFT_ELEMENT_UNKNOWN) ||
+      (combine == WEFT_COMBINE_OR && is_float)) {
+    return CUDA_ERROR_INVALID_VALUE;
+  }
+  if (!metadata.set_combine(reinterpret_cast<uint64_t>(f), param,
+                            static_cast<weft::Combine>(combine),
+                            static_cast<weft::Element>(element))) {
+    return CUDA_ERROR_INVALID_VALUE;
+  }
+  return CUDA_SUCCESS;
+}
+
+CUresult weftFuncSetElementwise(CUfunction f, unsigned int param) {
+  std::clog << "* " << std::setw(6) << getpid()
+            << " >> Received weftFuncSetElementwise! Function: " << f
+            << ", param: " << param << "\n";
+
+  if (!metadata.set_elementwise(reinterpret_cast<uint64_t>(f), param)) {
+    return CUDA_ERROR_INVALID_VALUE;
+  }
+  return CUDA_SUCCESS;
 }
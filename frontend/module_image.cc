@@ -0,0 +1,105 @@
+#include "module_image.h"
+
+#include <cuda.h>
+#include <elf.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "weft.pb.h"
+
+namespace weft {
+
+constexpr uint32_t fatbin_magic = 0xba55ed50;
+constexpr uint32_t fatbin_wrapper_magic = 0x466243b1;
+
+struct FatbinHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t header_size;
+  uint64_t fat_size;
+};
+
+struct FatbinWrapper {
+  int32_t magic;
+  int32_t version;
+  const void *data;
+  void *filename_or_fatbins;
+};
+
+// Cubins carry no explicit length, so take the furthest extent of the headers
+// and section contents
+template <typename Ehdr, typename Shdr>
+static size_t elf_size(const unsigned char *image) {
+  Ehdr ehdr;
+  std::memcpy(&ehdr, image, sizeof(ehdr));
+  size_t size = std::max<size_t>(
+      {sizeof(ehdr), ehdr.e_shoff + size_t{ehdr.e_shnum} * ehdr.e_shentsize,
+       ehdr.e_phoff + size_t{ehdr.e_phnum} * ehdr.e_phentsize});
+  for (size_t i = 0; i < ehdr.e_shnum; ++i) {
+    Shdr shdr;
+    std::memcpy(&shdr, image + ehdr.e_shoff + i * ehdr.e_shentsize,
+                sizeof(shdr));
+    if (shdr.sh_type != SHT_NOBITS) {
+      size = std::max<size_t>(size, shdr.sh_offset + shdr.sh_size);
+    }
+  }
+  return size;
+}
+
+static bool forward_option(CUjit_option option) {
+  switch (option) {
+    case CU_JIT_MAX_REGISTERS:
+    case CU_JIT_THREADS_PER_BLOCK:
+    case CU_JIT_OPTIMIZATION_LEVEL:
+    case CU_JIT_FALLBACK_STRATEGY:
+    case CU_JIT_GENERATE_DEBUG_INFO:
+    case CU_JIT_LOG_VERBOSE:
+    case CU_JIT_GENERATE_LINE_INFO:
+    case CU_JIT_CACHE_MODE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+Image make_image(const void *image, uint32_t numOptions, CUjit_option *options,
+                 void *optionValues[]) {
+  Image result;
+  auto bytes = static_cast<const unsigned char *>(image);
+
+  uint32_t magic;
+  std::memcpy(&magic, bytes, sizeof(magic));
+  if (magic == fatbin_wrapper_magic) {
+    FatbinWrapper wrapper;
+    std::memcpy(&wrapper, bytes, sizeof(wrapper));
+    bytes = static_cast<const unsigned char *>(wrapper.data);
+    std::memcpy(&magic, bytes, sizeof(magic));
+  }
+
+  if (magic == fatbin_magic) {
+    FatbinHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+    result.set_type(Image::FATBIN);
+    result.set_data(bytes, header.header_size + header.fat_size);
+  } else if (std::memcmp(bytes, ELFMAG, SELFMAG) == 0) {
+    result.set_type(Image::CUBIN);
+    result.set_data(bytes, bytes[EI_CLASS] == ELFCLASS64
+                               ? elf_size<Elf64_Ehdr, Elf64_Shdr>(bytes)
+                               : elf_size<Elf32_Ehdr, Elf32_Shdr>(bytes));
+  } else {
+    result.set_type(Image::PTX);
+    result.set_data(reinterpret_cast<const char *>(bytes));
+  }
+
+  for (uint32_t i = 0; i < numOptions; ++i) {
+    if (!forward_option(options[i])) continue;
+    auto option = result.add_options();
+    option->set_option(options[i]);
+    option->set_value(reinterpret_cast<uintptr_t>(optionValues[i]));
+  }
+  return result;
+}
+
+}  // namespace weft
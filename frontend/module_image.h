@@ -0,0 +1,20 @@
+#ifndef WEFT_FRONTEND_MODULE_IMAGE_H
+#define WEFT_FRONTEND_MODULE_IMAGE_H
+
+#include <cuda.h>
+
+#include "weft.pb.h"
+
+namespace weft {
+
+// Copies a cuModuleLoadDataEx image into an Image message. The image type is
+// detected from its header (ELF cubin, fatbin or fatbin wrapper, else PTX
+// text) and its size from the format. JIT options that affect code generation
+// are kept; log buffers, wall time and the target (chosen per device by the
+// server) are dropped.
+Image make_image(const void *image, uint32_t numOptions, CUjit_option *options,
+                 void *optionValues[]);
+
+}  // namespace weft
+
+#endif  // WEFT_FRONTEND_MODULE_IMAGE_H
@@ -1,73 +1,302 @@
 #include "nvrtc/kernel_parser.h"
 
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Attr.h>
 #include <clang/AST/Decl.h>
+#include <clang/AST/DeclCXX.h>
+#include <clang/AST/Expr.h>
+#include <clang/AST/ExprCXX.h>
+#include <clang/AST/ParentMapContext.h>
 #include <clang/Frontend/ASTUnit.h>
 #include <clang/Tooling/Tooling.h>
 
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <ostream>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
 
 namespace weft::nvrtc {
 
-Param::Param(const clang::ParmVarDecl* parm)
-    : qualified_name_{parm->getQualifiedNameAsString()},
-      type_{parm->getOriginalType().getAsString()},
-      size_{parm->getASTContext()
-                .getTypeSizeInChars(parm->getOriginalType())
-                .getQuantity()},
-      is_pointer_{parm->getOriginalType()->isPointerType()},
-      is_const_{is_pointer_ &&
-                parm->getOriginalType()->getPointeeType().isConstQualified()} {}
+namespace {
+
+// Reads and writes through the pointer parameters of a function body. Any use
+// the visitor cannot follow, e.g. passing the pointer on or taking the address
+// of an element, counts as both.
+class AccessVisitor : public clang::RecursiveASTVisitor<AccessVisitor> {
+ public:
+  AccessVisitor(clang::ASTContext& context) : context_{context} {}
+  bool VisitDeclRefExpr(clang::DeclRefExpr* ref);
+
+  Access access(const clang::ParmVarDecl* parm) const;
+
+ private:
+  struct Uses {
+    bool read = false;
+    bool write = false;
+  };
+
+  clang::ASTContext& context_;
+  std::unordered_map<const clang::ParmVarDecl*, Uses> uses_;
+
+  const clang::Stmt* parent(const clang::Stmt* stmt) const;
+  void classify(const clang::Expr* pointee, Uses& uses) const;
+};
+
+}  // namespace
+
+const clang::Stmt* AccessVisitor::parent(const clang::Stmt* stmt) const {
+  auto parents = context_.getParents(*stmt);
+  return parents.empty() ? nullptr : parents[0].get<clang::Stmt>();
+}
+
+bool AccessVisitor::VisitDeclRefExpr(clang::DeclRefExpr* ref) {
+  auto parm = llvm::dyn_cast<clang::ParmVarDecl>(ref->getDecl());
+  if (!parm || !parm->getType()->isPointerType()) return true;
+  auto& uses = uses_[parm];
+
+  // Follow the pointer value through casts and arithmetic to its dereference
+  const clang::Expr* value = ref;
+  while (auto up = parent(value)) {
+    if (llvm::isa<clang::ParenExpr>(up)) {
+      value = llvm::cast<clang::Expr>(up);
+      continue;
+    }
+    if (auto cast = llvm::dyn_cast<clang::CastExpr>(up)) {
+      if (cast->getType()->isPointerType()) {
+        value = cast;
+        continue;
+      }
+      if (cast->getCastKind() == clang::CK_PointerToBoolean) return true;
+    } else if (auto binary = llvm::dyn_cast<clang::BinaryOperator>(up)) {
+      if (binary->isAdditiveOp() && binary->getType()->isPointerType()) {
+        value = binary;
+        continue;
+      }
+      if (binary->isComparisonOp()) return true;
+      // Moving the pointer itself, e.g. p += stride or p = p + stride
+      auto lhs = binary->getLHS()->IgnoreParens();
+      if (binary->isAssignmentOp() &&
+          (lhs == value || (llvm::isa<clang::DeclRefExpr>(lhs) &&
+                            llvm::cast<clang::DeclRefExpr>(lhs)->getDecl() ==
+                                parm))) {
+        return true;
+      }
+    } else if (auto unary = llvm::dyn_cast<clang::UnaryOperator>(up)) {
+      if (unary->getOpcode() == clang::UO_Deref) {
+        classify(unary, uses);
+        return true;
+      }
+      if (unary->isIncrementDecrementOp() ||
+          unary->getOpcode() == clang::UO_LNot) {
+        return true;
+      }
+    } else if (auto subscript = llvm::dyn_cast<clang::ArraySubscriptExpr>(up)) {
+      if (subscript->getBase() == value) {
+        classify(subscript, uses);
+        return true;
+      }
+    } else if (auto member = llvm::dyn_cast<clang::MemberExpr>(up)) {
+      if (member->isArrow()) {
+        classify(member, uses);
+        return true;
+      }
+    }
+    break;
+  }
+
+  uses.read = uses.write = true;
+  return true;
+}
+
+// Whether the element an access resolved to is loaded, stored or both
+void AccessVisitor::classify(const clang::Expr* pointee, Uses& uses) const {
+  const clang::Expr* value = pointee;
+  while (auto up = parent(value)) {
+    if (llvm::isa<clang::ParenExpr>(up)) {
+      value = llvm::cast<clang::Expr>(up);
+      continue;
+    }
+    if (auto member = llvm::dyn_cast<clang::MemberExpr>(up)) {
+      if (!member->isArrow()) {
+        value = member;
+        continue;
+      }
+    } else if (auto cast = llvm::dyn_cast<clang::ImplicitCastExpr>(up)) {
+      if (cast->getCastKind() == clang::CK_LValueToRValue) {
+        uses.read = true;
+        return;
+      }
+      if (cast->getCastKind() == clang::CK_NoOp) {
+        value = cast;
+        continue;
+      }
+    } else if (auto binary = llvm::dyn_cast<clang::BinaryOperator>(up)) {
+      if (binary->isAssignmentOp() && binary->getLHS() == value) {
+        uses.write = true;
+        uses.read = uses.read || binary->isCompoundAssignmentOp();
+        return;
+      }
+    } else if (auto unary = llvm::dyn_cast<clang::UnaryOperator>(up)) {
+      if (unary->isIncrementDecrementOp()) {
+        uses.read = uses.write = true;
+        return;
+      }
+    } else if (auto construct = llvm::dyn_cast<clang::CXXConstructExpr>(up)) {
+      if (construct->getConstructor()->isCopyOrMoveConstructor()) {
+        uses.read = true;
+        return;
+      }
+    }
+    break;
+  }
+
+  uses.read = uses.write = true;
+}
+
+Access AccessVisitor::access(const clang::ParmVarDecl* parm) const {
+  auto it = uses_.find(parm);
+  if (it == uses_.end()) return Access::unused;
+
+  // Writes through a pointer to const would not compile without a cast
+  bool write = it->second.write &&
+               !parm->getType()->getPointeeType().isConstQualified();
+  if (it->second.read) return write ? Access::read_write : Access::read_only;
+  return write ? Access::write_only : Access::unused;
+}
+
+// From an annotate("weft_sum") etc. attribute, see weft/combine.h
+static Combine annotated_combine(const clang::ParmVarDecl* parm) {
+  for (const auto* attr : parm->specific_attrs<clang::AnnotateAttr>()) {
+    auto annotation = attr->getAnnotation();
+    if (annotation == "weft_sum") return Combine::sum;
+    if (annotation == "weft_min") return Combine::min;
+    if (annotation == "weft_max") return Combine::max;
+    if (annotation == "weft_or") return Combine::bit_or;
+  }
+  return Combine::none;
+}
+
+// From an annotate("weft_elementwise") attribute, see weft/pipeline.h
+static bool annotated_elementwise(const clang::ParmVarDecl* parm) {
+  for (const auto* attr : parm->specific_attrs<clang::AnnotateAttr>()) {
+    if (attr->getAnnotation() == "weft_elementwise") return true;
+  }
+  return false;
+}
+
+static Element element(const clang::ASTContext& context,
+                       clang::QualType type) {
+  if (!type->isArithmeticType() || type->isIncompleteType()) {
+    return Element::unknown;
+  }
+  auto size = context.getTypeSize(type);
+  if (type->isRealFloatingType()) {
+    return size == 32   ? Element::float32
+           : size == 64 ? Element::float64
+                        : Element::unknown;
+  }
+  bool is_signed = type->isSignedIntegerType();
+  if (size == 32) return is_signed ? Element::int32 : Element::uint32;
+  if (size == 64) return is_signed ? Element::int64 : Element::uint64;
+  return Element::unknown;
+}
+
+Param make_param(const clang::ParmVarDecl* parm, Access access) {
+  auto& context = parm->getASTContext();
+  auto type = parm->getOriginalType();
+  bool is_pointer = type->isPointerType();
+  auto pointee = is_pointer ? type->getPointeeType() : clang::QualType();
+  Param param(
+      parm->getQualifiedNameAsString(), type.getAsString(),
+      context.getTypeSizeInChars(type).getQuantity(),
+      is_pointer && !pointee->isIncompleteType()
+          ? context.getTypeSizeInChars(pointee).getQuantity()
+          : 0,
+      is_pointer, is_pointer && pointee.isConstQualified(), access,
+      context.getTypeAlignInChars(type).getQuantity());
+
+  auto combine = annotated_combine(parm);
+  if (combine != Combine::none && is_pointer) {
+    auto kind = element(context, pointee);
+    bool is_float = kind == Element::float32 || kind == Element::float64;
+    if (kind == Element::unknown || (combine == Combine::bit_or && is_float)) {
+      llvm::errs() << "Warning: cannot combine into "
+                   << parm->getQualifiedNameAsString() << " of type "
+                   << pointee.getAsString() << "\n";
+    } else {
+      param.set_combine(combine, kind);
+    }
+  }
+  param.set_elementwise(is_pointer && annotated_elementwise(parm));
+  return param;
+}
 
 bool KernelVisitor::VisitFunctionDecl(clang::FunctionDecl* func) {
   auto name = func->getNameInfo().getName().getAsString();
-  if (func->getNumParams()) {
-    metadata_.emplace(name, std::make_shared<std::vector<Param>>());
-    for (auto const& parm : func->parameters()) {
-      // Exclude _weft parameters
-      if (parm->getQualifiedNameAsString().rfind("_weft", 0)) {
-        metadata_.at(name)->emplace_back(parm);
-      }
+  if (!func->getNumParams()) return true;
+
+  // Accesses are only known from a body, which overrides any prototype
+  bool has_body = func->doesThisDeclarationHaveABody();
+  if (!has_body && metadata_.contains(name)) return true;
+
+  AccessVisitor accesses(func->getASTContext());
+  if (has_body) accesses.TraverseStmt(func->getBody());
+
+  std::vector<Param> params;
+  for (auto const& parm : func->parameters()) {
+    // Exclude _weft parameters
+    if (parm->getQualifiedNameAsString().rfind("_weft", 0)) {
+      params.push_back(make_param(
+          parm, has_body ? accesses.access(parm) : Access::read_write));
     }
   }
+
+  llvm::errs() << name << "\n";
+  for (const auto& param : params) {
+    llvm::errs() << "\t" << param << "\n";
+  }
+  if (std::find(names_.begin(), names_.end(), name) == names_.end()) {
+    names_.push_back(name);
+  }
+  metadata_.set(std::move(name), std::move(params));
   return true;
 }
 
-void KernelMetadata::parse_cu(std::string src) {
+std::vector<std::string> parse_cu(const std::string& src,
+                                  KernelMetadata& metadata) {
   // Generate AST from source with clang
   // TODO: is there .cu support (CUDA C++ extension parsing errors)
   std::unique_ptr<clang::ASTUnit> ast(clang::tooling::buildASTFromCode(src));
   auto* decl = ast->getASTContext().getTranslationUnitDecl();
-  if (decl) {
+  if (!decl) return {};
+
+  if (std::getenv("WEFT_DUMP_AST")) {
     llvm::errs() << "---------clang dump begin----------\n";
     decl->dump();
     llvm::errs() << "---------clang dump end----------\n";
-
-    llvm::errs() << "---------AST KernelVisitor traversal begin----------\n";
-    kernel_visitor_.TraverseDecl(decl);
-    for (const auto& item : metadata_) {
-      llvm::errs() << item.first << "\n";
-      for (const auto& param : *item.second) {
-        llvm::errs() << "\t" << param << "\n";
-      }
-    }
-    llvm::errs() << "---------AST KernelVisitor traversal end----------\n";
   }
-}
 
-std::ostream& operator<<(std::ostream& os, const weft::nvrtc::Param& param) {
-  os << param.qualified_name_ << " - " << param.type_
-     << ", size: " << param.size_ << ", pointer: " << param.is_pointer_
-     << ", const: " << param.is_const_;
-  return os;
+  llvm::errs() << "---------AST KernelVisitor traversal begin----------\n";
+  KernelVisitor visitor(metadata);
+  visitor.TraverseDecl(decl);
+  llvm::errs() << "---------AST KernelVisitor traversal end----------\n";
+  return visitor.names();
 }
 
-llvm::raw_ostream& operator<<(llvm::raw_ostream& os,
-                              const weft::nvrtc::Param& param) {
-  os << param.qualified_name_ << " - " << param.type_
-     << ", size: " << param.size_ << ", pointer: " << param.is_pointer_
-     << ", const: " << param.is_const_;
-  return os;
+llvm::raw_ostream& operator<<(llvm::raw_ostream& os, const Param& param) {
+  std::ostringstream text;
+  text << param;
+  return os << text.str();
 }
 
 }  // namespace weft::nvrtc
+
+void weft_nvrtc_parse_cu(const std::string* src,
+                         weft::KernelMetadata* metadata,
+                         std::vector<std::string>* names) {
+  *names = weft::nvrtc::parse_cu(*src, *metadata);
+}
@@ -5,73 +5,40 @@
 #include <clang/AST/RecursiveASTVisitor.h>
 #include <clang/AST/Type.h>
 
-#include <memory>
-#include <ostream>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
-namespace weft::nvrtc {
+#include "kernel_metadata.h"
 
-class Param {
- public:
-  Param(const clang::ParmVarDecl* parm);
+// Built into the clang plugin only, see plugin.h
+namespace weft::nvrtc {
 
-  constexpr size_t size() const noexcept { return size_; }
-  constexpr size_t pointee_size() const noexcept { return pointee_size_; }
-  constexpr bool is_pointer() const noexcept { return is_pointer_; }
-  constexpr bool is_const() const noexcept { return is_const_; }
+Param make_param(const clang::ParmVarDecl* parm,
+                 Access access = Access::read_write);
 
-  friend std::ostream& operator<<(std::ostream& os, const Param& param);
-  friend llvm::raw_ostream& operator<<(llvm::raw_ostream& os,
-                                       const Param& param);
-
- private:
-  std::string qualified_name_;
-  std::string type_;
-  size_t size_;
-  size_t pointee_size_;
-  bool is_pointer_;
-  bool is_const_;
-};
-
-template <typename T>
-using metadata_t = std::unordered_map<T, std::shared_ptr<std::vector<Param>>>;
+llvm::raw_ostream& operator<<(llvm::raw_ostream& os, const Param& param);
 
 class KernelVisitor : public clang::RecursiveASTVisitor<KernelVisitor> {
  public:
-  KernelVisitor(metadata_t<std::string>& metadata) : metadata_{metadata} {}
+  KernelVisitor(KernelMetadata& metadata) : metadata_{metadata} {}
   bool VisitFunctionDecl(clang::FunctionDecl* func);
 
- private:
-  metadata_t<std::string>& metadata_;
-};
-
-class KernelMetadata {
- public:
-  KernelMetadata() : kernel_visitor_{metadata_} {}
-
-  const std::shared_ptr<std::vector<Param>>& at(std::string name) const {
-    return metadata_.at(name);
-  }
-
-  const std::shared_ptr<std::vector<Param>>& at(uint64_t handle) const {
-    return metadata_handle_.at(handle);
-  }
-
-  auto emplace(uint64_t function_handle,
-               const std::shared_ptr<std::vector<Param>>& vec_ptr) {
-    return metadata_handle_.emplace(function_handle, vec_ptr);
-  }
-
-  void parse_cu(std::string src);
+  const std::vector<std::string>& names() const noexcept { return names_; }
 
  private:
-  KernelVisitor kernel_visitor_;
-  metadata_t<std::string> metadata_;
-  metadata_t<uint64_t> metadata_handle_;
+  KernelMetadata& metadata_;
+  std::vector<std::string> names_;  // of the functions recorded
 };
 
+// Records the signatures of the functions defined in a CUDA source and returns
+// their names. The AST is dumped to stderr if WEFT_DUMP_AST is set.
+std::vector<std::string> parse_cu(const std::string& src,
+                                  KernelMetadata& metadata);
+
 }  // namespace weft::nvrtc
 
+extern "C" void weft_nvrtc_parse_cu(const std::string* src,
+                                    weft::KernelMetadata* metadata,
+                                    std::vector<std::string>* names);
+
 #endif  // WEFT_FRONTEND_NVRTC_KERNEL_PARSER_H
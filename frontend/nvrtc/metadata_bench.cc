@@ -0,0 +1,88 @@
+// Times what the interposer spends on the kernel metadata of a CUDA source:
+// loading the clang plugin, parsing the source with it, and loading the
+// signatures back from the on-disk cache instead. Needs no GPU.
+//
+//   weft_metadata_bench <source.cu> [runs]
+//
+// Set WEFT_CACHE_DIR to keep the entries it stores out of the real cache.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "kernel_metadata.h"
+#include "nvrtc/plugin.h"
+#include "weft/hash.h"
+
+using clock_type = std::chrono::steady_clock;
+
+static double since(clock_type::time_point start) {
+  return std::chrono::duration<double, std::milli>(clock_type::now() - start)
+      .count();
+}
+
+static void report(const char *what, std::vector<double> ms) {
+  auto first = ms.front();
+  std::sort(ms.begin(), ms.end());
+  std::cout << std::fixed << std::setprecision(3) << what << ": first "
+            << first << " ms, median " << ms[ms.size() / 2] << " ms, p90 "
+            << ms[ms.size() * 9 / 10] << " ms over " << ms.size()
+            << " runs\n";
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " <source.cu> [runs]\n";
+    return EXIT_FAILURE;
+  }
+  std::ifstream file(argv[1]);
+  if (!file) {
+    std::cerr << "cannot read " << argv[1] << "\n";
+    return EXIT_FAILURE;
+  }
+  std::string src(std::istreambuf_iterator<char>(file), {});
+  int runs = argc > 2 ? std::max(1, std::atoi(argv[2])) : 20;
+
+  // What a process pays on its first NVRTC program since libweft.so stopped
+  // linking clang, and what every process paid at startup before
+  auto start = clock_type::now();
+  auto parse_cu = weft::nvrtc::parse_cu_plugin();
+  std::cout << std::fixed << std::setprecision(3)
+            << "plugin load: " << since(start) << " ms\n";
+  if (!parse_cu) return EXIT_FAILURE;
+
+  auto key = weft::Sha256()
+                 .update_field(weft::nvrtc::parser_version)
+                 .update(src)
+                 .digest();
+  std::vector<double> parsed_ms, loaded_ms;
+  for (int i = 0; i < runs; ++i) {
+    weft::KernelMetadata parsed;
+    std::vector<std::string> names;
+    start = clock_type::now();
+    parse_cu(&src, &parsed, &names);
+    parsed_ms.push_back(since(start));
+
+    weft::KernelMetadata metadata;
+    metadata.add_source(key, parsed, names);
+    metadata.store(key);
+  }
+  for (int i = 0; i < runs; ++i) {
+    weft::KernelMetadata metadata;
+    start = clock_type::now();
+    if (!metadata.load(key)) {
+      std::cerr << "cache entry missing\n";
+      return EXIT_FAILURE;
+    }
+    loaded_ms.push_back(since(start));
+  }
+  report("clang parse", std::move(parsed_ms));
+  report("cache load", std::move(loaded_ms));
+  return EXIT_SUCCESS;
+}
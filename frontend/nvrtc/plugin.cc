@@ -0,0 +1,57 @@
+#include "nvrtc/plugin.h"
+
+#include <dlfcn.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace weft::nvrtc {
+
+static std::string plugin_path() {
+  if (const char *path = std::getenv("WEFT_CLANG_PLUGIN")) return path;
+
+  Dl_info info;
+  if (dladdr(reinterpret_cast<void *>(&parse_cu_plugin), &info) &&
+      info.dli_fname) {
+    return (std::filesystem::path(info.dli_fname).parent_path() /
+            "libweft_clang.so")
+        .string();
+  }
+  return "libweft_clang.so";
+}
+
+fnParseCu parse_cu_plugin() {
+  static const fnParseCu parse_cu = []() -> fnParseCu {
+    auto start = std::chrono::steady_clock::now();
+    auto path = plugin_path();
+    void *plugin = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!plugin) {
+      std::clog << "* " << std::setw(6) << getpid()
+                << " >> No clang plugin (" << dlerror()
+                << "), using PTX signatures only\n";
+      return nullptr;
+    }
+
+    auto parse_cu = reinterpret_cast<fnParseCu>(dlsym(plugin, parse_cu_symbol));
+    if (!parse_cu) {
+      std::clog << "* " << std::setw(6) << getpid() << " >> " << path
+                << " is not a clang plugin (" << dlerror()
+                << "), using PTX signatures only\n";
+      dlclose(plugin);
+      return nullptr;
+    }
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::clog << "* " << std::setw(6) << getpid() << " >> Loaded " << path
+              << " in " << elapsed.count() << " ms\n";
+    return parse_cu;
+  }();
+  return parse_cu;
+}
+
+}  // namespace weft::nvrtc
@@ -0,0 +1,30 @@
+#ifndef WEFT_FRONTEND_NVRTC_PLUGIN_H
+#define WEFT_FRONTEND_NVRTC_PLUGIN_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "kernel_metadata.h"
+
+namespace weft::nvrtc {
+
+// Changes whenever parse_cu could produce different signatures for the same
+// source, as it keys the on-disk metadata
+constexpr std::string_view parser_version =
+    "clang-11 access-1 combine-1 elementwise-1";
+
+// Entry point exported by the clang plugin (libweft_clang.so). It records the
+// signatures of the functions defined in a CUDA source and their names.
+using fnParseCu = void (*)(const std::string *src, KernelMetadata *metadata,
+                           std::vector<std::string> *names);
+constexpr const char *parse_cu_symbol = "weft_nvrtc_parse_cu";
+
+// The plugin's parse_cu, dlopen'd on first use so processes that never use
+// NVRTC don't map clang. Looked up as $WEFT_CLANG_PLUGIN, else next to
+// libweft.so. Null if it cannot be loaded, leaving only PTX signatures.
+fnParseCu parse_cu_plugin();
+
+}  // namespace weft::nvrtc
+
+#endif  // WEFT_FRONTEND_NVRTC_PLUGIN_H
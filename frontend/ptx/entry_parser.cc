@@ -0,0 +1,169 @@
+#include "ptx/entry_parser.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "kernel_metadata.h"
+
+namespace weft::ptx {
+
+static bool is_identifier(char c) {
+  return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$' ||
+         c == '%';
+}
+
+// Position just past the bracket matching the one at `open`
+static size_t skip_balanced(std::string_view ptx, size_t open) {
+  int depth = 0;
+  for (size_t i = open; i < ptx.size(); ++i) {
+    if (ptx[i] == '(' || ptx[i] == '{') ++depth;
+    if (ptx[i] == ')' || ptx[i] == '}') {
+      if (--depth == 0) return i + 1;
+    }
+  }
+  return std::string_view::npos;
+}
+
+static std::vector<std::string_view> split(std::string_view text,
+                                           std::string_view separators) {
+  std::vector<std::string_view> parts;
+  for (size_t begin = text.find_first_not_of(separators);
+       begin != std::string_view::npos;) {
+    auto end = text.find_first_of(separators, begin);
+    parts.push_back(text.substr(begin, end - begin));
+    if (end == std::string_view::npos) break;
+    begin = text.find_first_not_of(separators, end);
+  }
+  return parts;
+}
+
+// Bytes of a fundamental type such as .u32, .f16x2 or .b8, 0 if unknown
+static size_t type_size(std::string_view type) {
+  if (type == ".pred") return 1;
+  auto digits = type.find_first_of("0123456789");
+  if (type.size() < 3 || digits == std::string_view::npos ||
+      std::string_view("bsuf").find(type[1]) == std::string_view::npos) {
+    return 0;
+  }
+  auto bits = std::strtoul(std::string(type.substr(digits)).c_str(), nullptr,
+                           10);
+  return type.find("x2") != std::string_view::npos ? bits / 4 : bits / 8;
+}
+
+// Whether a parameter is loaded into a register that is then converted to a
+// global address or dereferenced
+static bool used_as_address(std::string_view body, std::string_view name) {
+  auto operand = "[" + std::string(name) + "]";
+  for (auto pos = body.find(operand); pos != std::string_view::npos;
+       pos = body.find(operand, pos + 1)) {
+    auto begin = body.find_last_of(";{}", pos) + 1;
+    auto instruction = split(body.substr(begin, pos - begin), " \t\r\n,");
+    if (instruction.size() != 2 || instruction[0].rfind("ld.param", 0) != 0) {
+      continue;
+    }
+
+    auto reg = std::string(instruction[1]);
+    for (auto use = body.find(reg); use != std::string_view::npos;
+         use = body.find(reg, use + 1)) {
+      auto end = use + reg.size();
+      if (end < body.size() && is_identifier(body[end])) continue;
+      if (use > 0 && body[use - 1] == '[') return true;  // [%rd1] or [%rd1+8]
+
+      auto line = body.find_last_of(";{}", use) + 1;
+      auto mnemonic = split(body.substr(line, use - line), " \t\r\n");
+      if (!mnemonic.empty() && mnemonic[0].rfind("cvta", 0) == 0) return true;
+    }
+  }
+  return false;
+}
+
+static Param parse_param(std::string_view declaration, std::string_view body) {
+  std::string type;
+  size_t element_size = 0, count = 1, align = 0;
+  bool is_pointer = false, is_const = false;
+  std::string_view name;
+
+  auto tokens = split(declaration, " \t\r\n");
+  for (size_t i = 0; i < tokens.size(); ++i) {
+    auto token = tokens[i];
+    if (token == ".param") continue;
+    if (token == ".align" && i + 1 < tokens.size()) {
+      auto value = std::strtoul(std::string(tokens[++i]).c_str(), nullptr, 10);
+      if (!is_pointer) align = value;  // after .ptr it is the pointee's
+    } else if (token == ".ptr") {
+      is_pointer = true;
+    } else if (is_pointer && (token == ".global" || token == ".const" ||
+                              token == ".shared" || token == ".local")) {
+      is_const = token == ".const";
+    } else if (token[0] == '.' && !element_size) {
+      type = std::string(token);
+      element_size = type_size(token);
+    } else if (token[0] == '[') {
+      count = std::strtoul(std::string(token.substr(1)).c_str(), nullptr, 10);
+    } else {
+      auto bracket = token.find('[');
+      name = token.substr(0, bracket);
+      if (bracket != std::string_view::npos) {
+        count = std::strtoul(std::string(token.substr(bracket + 1)).c_str(),
+                             nullptr, 10);
+      }
+    }
+  }
+
+  if (!is_pointer && count == 1 && element_size == 8 &&
+      (type == ".u64" || type == ".b64" || type == ".s64")) {
+    is_pointer = used_as_address(body, name);
+  }
+  if (count != 1) type += "[" + std::to_string(count) + "]";
+  return Param(std::string(name), std::move(type), element_size * count, 0,
+               is_pointer, is_const, Access::read_write,
+               align ? align : element_size);
+}
+
+std::vector<Entry> parse_entries(std::string_view ptx) {
+  std::vector<Entry> entries;
+  for (auto pos = ptx.find(".entry"); pos != std::string_view::npos;
+       pos = ptx.find(".entry", pos + 1)) {
+    auto name_begin = ptx.find_first_not_of(" \t\r\n", pos + 6);
+    if (name_begin == pos + 6 || name_begin == std::string_view::npos) {
+      continue;
+    }
+    auto name_end = name_begin;
+    while (name_end < ptx.size() && is_identifier(ptx[name_end])) ++name_end;
+
+    Entry entry{std::string(ptx.substr(name_begin, name_end - name_begin)),
+                {}};
+    std::string_view params;
+    auto cursor = ptx.find_first_not_of(" \t\r\n", name_end);
+    if (cursor != std::string_view::npos && ptx[cursor] == '(') {
+      auto close = skip_balanced(ptx, cursor);
+      if (close == std::string_view::npos) break;
+      params = ptx.substr(cursor + 1, close - cursor - 2);
+      cursor = close;
+    }
+
+    // Performance directives may sit between the signature and the body
+    auto open = ptx.find_first_of("{;", cursor);
+    if (open == std::string_view::npos) break;
+    std::string_view body;
+    if (ptx[open] == '{') {
+      auto close = skip_balanced(ptx, open);
+      if (close == std::string_view::npos) break;
+      body = ptx.substr(open, close - open);
+      pos = close - 1;
+    }
+
+    for (auto declaration : split(params, ",")) {
+      if (declaration.find(".param") != std::string_view::npos) {
+        entry.params.push_back(parse_param(declaration, body));
+      }
+    }
+    entries.push_back(std::move(entry));
+  }
+  return entries;
+}
+
+}  // namespace weft::ptx
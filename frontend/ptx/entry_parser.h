@@ -0,0 +1,25 @@
+#ifndef WEFT_FRONTEND_PTX_ENTRY_PARSER_H
+#define WEFT_FRONTEND_PTX_ENTRY_PARSER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "kernel_metadata.h"
+
+namespace weft::ptx {
+
+struct Entry {
+  std::string name;
+  std::vector<Param> params;
+};
+
+// Kernel signatures from the .entry declarations of a PTX module. Sizes and
+// alignment come from the .param types. A .u64/.b64 parameter is a pointer if
+// it carries a .ptr hint (.ptr .const makes it const) or the body uses it as
+// an address; constness and access are otherwise unknown.
+std::vector<Entry> parse_entries(std::string_view ptx);
+
+}  // namespace weft::ptx
+
+#endif  // WEFT_FRONTEND_PTX_ENTRY_PARSER_H
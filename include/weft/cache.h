@@ -0,0 +1,93 @@
+#ifndef WEFT_CACHE_H
+#define WEFT_CACHE_H
+
+#include <unistd.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+
+namespace weft::cache {
+
+namespace fs = std::filesystem;
+
+inline fs::path default_directory() {
+  if (const char *dir = std::getenv("WEFT_CACHE_DIR")) return dir;
+  if (const char *xdg = std::getenv("XDG_CACHE_HOME")) {
+    return fs::path(xdg) / "weft";
+  }
+  if (const char *home = std::getenv("HOME")) {
+    return fs::path(home) / ".cache" / "weft";
+  }
+  return fs::temp_directory_path() / "weft";
+}
+
+// Content-addressed store on local disk, persisted across restarts and shared
+// by the server (modules) and the interposer (kernel metadata). Location is
+// $WEFT_CACHE_DIR, else $XDG_CACHE_HOME/weft, else ~/.cache/weft.
+inline const fs::path &directory() {
+  static const fs::path dir = [] {
+    auto dir = default_directory();
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if (ec) {
+      std::cerr << "> Cache: cannot create " << dir << " (" << ec.message()
+                << ")\n";
+    } else {
+      std::clog << "> Cache: using " << dir << "\n";
+    }
+    return dir;
+  }();
+  return dir;
+}
+
+inline bool contains(std::string_view key) {
+  std::error_code ec;
+  return fs::exists(directory() / key, ec);
+}
+
+inline std::optional<std::string> load(std::string_view key) {
+  std::ifstream file(directory() / key, std::ios::binary);
+  if (!file) return std::nullopt;
+  return std::string(std::istreambuf_iterator<char>(file),
+                     std::istreambuf_iterator<char>());
+}
+
+inline void store(std::string_view key, std::string_view data) {
+  auto path = directory() / key;
+
+  // Write to a private temporary and rename, so concurrent processes sharing
+  // the directory never observe a partially written entry
+  std::ostringstream tmp_name;
+  tmp_name << path.filename().string() << ".tmp." << getpid() << "."
+           << std::this_thread::get_id();
+  auto tmp_path = path.parent_path() / tmp_name.str();
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), data.size());
+    if (!file) {
+      std::cerr << "> Cache: failed to write " << tmp_path << "\n";
+      return;
+    }
+  }
+
+  std::error_code ec;
+  fs::rename(tmp_path, path, ec);
+  if (ec) {
+    std::cerr << "> Cache: failed to store " << path << " (" << ec.message()
+              << ")\n";
+    fs::remove(tmp_path, ec);
+  }
+}
+
+}  // namespace weft::cache
+
+#endif  // WEFT_CACHE_H
@@ -0,0 +1,52 @@
+#ifndef WEFT_COMBINE_H
+#define WEFT_COMBINE_H
+
+#include <cuda.h>
+
+/* For applications run under libweft. A kernel that accumulates into an
+ * output, e.g. a sum with atomicAdd, gives wrong results when its grid is
+ * split across devices unless weft knows how to merge the parts. Each part
+ * then accumulates into a private copy starting from the identity, and the
+ * server combines them into the buffer.
+ *
+ * In sources compiled with NVRTC, annotate the parameter instead:
+ *   __attribute__((annotate("weft_sum"))) float *out
+ * with weft_sum, weft_min, weft_max or weft_or; the element type is that of
+ * the pointee. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum weft_combine {
+  WEFT_COMBINE_NONE,
+  WEFT_COMBINE_SUM,
+  WEFT_COMBINE_MIN,
+  WEFT_COMBINE_MAX,
+  WEFT_COMBINE_OR,
+} weft_combine;
+
+typedef enum weft_element {
+  WEFT_ELEMENT_UNKNOWN,
+  WEFT_ELEMENT_INT32,
+  WEFT_ELEMENT_UINT32,
+  WEFT_ELEMENT_FLOAT32,
+  WEFT_ELEMENT_INT64,
+  WEFT_ELEMENT_UINT64,
+  WEFT_ELEMENT_FLOAT64,
+} weft_element;
+
+/* Sets how launches of a function combine into one of its pointer
+ * parameters, by index. CUDA_ERROR_INVALID_VALUE if the parameter is not a
+ * pointer or OR is asked of floats. Weak, so it is null when the application
+ * runs without libweft. */
+__attribute__((weak)) CUresult weftFuncSetCombine(CUfunction f,
+                                                  unsigned int param,
+                                                  weft_combine combine,
+                                                  weft_element element);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WEFT_COMBINE_H */
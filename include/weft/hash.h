@@ -0,0 +1,166 @@
+#ifndef WEFT_HASH_H
+#define WEFT_HASH_H
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace weft {
+
+// 64-bit FNV-1a. Unlike std::hash this is stable across builds and hosts. Only
+// for keys where a collision costs time, not correctness; content keys use
+// Sha256.
+constexpr uint64_t fnv1a_seed = 0xcbf29ce484222325ull;
+
+constexpr uint64_t fnv1a(std::string_view data,
+                         uint64_t hash = fnv1a_seed) noexcept {
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+template <typename T>
+uint64_t fnv1a_value(const T &value, uint64_t hash = fnv1a_seed) noexcept {
+  static_assert(std::is_trivially_copyable_v<T>);
+  return fnv1a(
+      std::string_view(reinterpret_cast<const char *>(&value), sizeof(T)),
+      hash);
+}
+
+// SHA-256 (FIPS 180-4). Content keys use it because what they find is trusted
+// without comparing it: cached modules and metadata on disk, and modules
+// offered by hash alone, possibly by another client.
+class Sha256 {
+ public:
+  Sha256 &update(std::string_view data) noexcept {
+    for (unsigned char c : data) {
+      block_[used_++] = c;
+      if (used_ == block_.size()) {
+        compress();
+        used_ = 0;
+      }
+    }
+    length_ += data.size();
+    return *this;
+  }
+
+  template <typename T>
+  Sha256 &update_value(const T &value) noexcept {
+    static_assert(std::is_trivially_copyable_v<T>);
+    return update(
+        std::string_view(reinterpret_cast<const char *>(&value), sizeof(T)));
+  }
+
+  // Length-prefixed, so adjacent fields cannot run into each other
+  Sha256 &update_field(std::string_view data) noexcept {
+    return update_value(static_cast<uint64_t>(data.size())).update(data);
+  }
+
+  // 32 raw bytes. Ends the hash; no update may follow.
+  std::string digest() noexcept {
+    auto bits = length_ * 8;
+    block_[used_++] = 0x80;
+    if (used_ > 56) {
+      std::memset(block_.data() + used_, 0, block_.size() - used_);
+      compress();
+      used_ = 0;
+    }
+    std::memset(block_.data() + used_, 0, 56 - used_);
+    for (int i = 0; i < 8; ++i) block_[63 - i] = bits >> (8 * i);
+    compress();
+
+    std::string digest(32, '\0');
+    for (size_t i = 0; i < 32; ++i) {
+      digest[i] = state_[i / 4] >> (24 - i % 4 * 8);
+    }
+    return digest;
+  }
+
+ private:
+  std::array<uint32_t, 8> state_{0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                 0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                 0x1f83d9ab, 0x5be0cd19};
+  std::array<unsigned char, 64> block_{};
+  size_t used_ = 0;
+  uint64_t length_ = 0;
+
+  static constexpr uint32_t rotr(uint32_t x, int n) noexcept {
+    return (x >> n) | (x << (32 - n));
+  }
+
+  void compress() noexcept {
+    static constexpr uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+        0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+        0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+        0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+        0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+        0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+        0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+        0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+        0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i) {
+      w[i] = uint32_t{block_[4 * i]} << 24 | uint32_t{block_[4 * i + 1]} << 16 |
+             uint32_t{block_[4 * i + 2]} << 8 | block_[4 * i + 3];
+    }
+    for (int i = 16; i < 64; ++i) {
+      auto s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      auto s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    auto [a, b, c, d, e, f, g, h] = state_;
+    for (int i = 0; i < 64; ++i) {
+      auto t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) +
+                ((e & f) ^ (~e & g)) + k[i] + w[i];
+      auto t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) +
+                ((a & b) ^ (a & c) ^ (b & c));
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    uint32_t add[8] = {a, b, c, d, e, f, g, h};
+    for (int i = 0; i < 8; ++i) state_[i] += add[i];
+  }
+};
+
+inline std::string sha256(std::string_view data) {
+  return Sha256().update(data).digest();
+}
+
+inline std::string to_hex(uint64_t hash) {
+  char buf[17];
+  std::snprintf(buf, sizeof(buf), "%016llx",
+                static_cast<unsigned long long>(hash));
+  return buf;
+}
+
+inline std::string to_hex(std::string_view bytes) {
+  static constexpr char digits[] = "0123456789abcdef";
+  std::string hex;
+  hex.reserve(bytes.size() * 2);
+  for (unsigned char c : bytes) {
+    hex += digits[c >> 4];
+    hex += digits[c & 0xf];
+  }
+  return hex;
+}
+
+}  // namespace weft
+
+#endif  // WEFT_HASH_H
@@ -0,0 +1,37 @@
+#ifndef WEFT_IMAGE_H
+#define WEFT_IMAGE_H
+
+#include <cstdint>
+#include <string>
+
+#include "weft.pb.h"
+#include "weft/hash.h"
+
+namespace weft {
+
+// Identity of a module image: the SHA-256 of its bytes, type, JIT and compile
+// options. Client and server must agree on it for hash-only module loads.
+inline std::string hash(const Image &image) {
+  Sha256 hash;
+  hash.update_field(image.data());
+  hash.update_value(static_cast<int32_t>(image.type()));
+  hash.update_value(static_cast<uint64_t>(image.options_size()));
+  for (const auto &option : image.options()) {
+    hash.update_value(option.option());
+    hash.update_value(option.value());
+  }
+  hash.update_field(image.name());
+  hash.update_value(static_cast<uint64_t>(image.headers_size()));
+  for (const auto &header : image.headers()) {
+    hash.update_field(header.name()).update_field(header.src());
+  }
+  hash.update_value(static_cast<uint64_t>(image.compile_options_size()));
+  for (const auto &option : image.compile_options()) {
+    hash.update_field(option);
+  }
+  return hash.update_value(image.specialize()).digest();
+}
+
+}  // namespace weft
+
+#endif  // WEFT_IMAGE_H
@@ -0,0 +1,31 @@
+#ifndef WEFT_PIPELINE_H
+#define WEFT_PIPELINE_H
+
+#include <cuda.h>
+
+/* For applications run under libweft. With WEFT_PIPELINE set, the server
+ * runs a 1-D launch as waves of blocks, each copying only its part of the
+ * buffers, so copies overlap the kernel. That is only correct for kernels
+ * where thread i uses nothing but element i of each buffer, e.g. vectorAdd,
+ * which weft cannot tell from the kernel itself, so every buffer the kernel
+ * uses must be declared elementwise or the launch runs as usual.
+ *
+ * In sources compiled with NVRTC, annotate the parameter instead:
+ *   __attribute__((annotate("weft_elementwise"))) const float *a */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Declares that thread i of a 1-D launch of the function only uses element i
+ * behind one of its pointer parameters, by index. CUDA_ERROR_INVALID_VALUE
+ * if the parameter is not a pointer. Weak, so it is null when the
+ * application runs without libweft. */
+__attribute__((weak)) CUresult weftFuncSetElementwise(CUfunction f,
+                                                      unsigned int param);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WEFT_PIPELINE_H */
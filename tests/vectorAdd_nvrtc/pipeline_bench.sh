@@ -0,0 +1,57 @@
+#!/usr/bin/env bash
+# Times vectorAdd_nvrtc under Weft with launches run serially and in waves
+# (WEFT_PIPELINE), restarting the server for each, and reports the median
+# "Elapsed time" of each. Run from this directory after `make`.
+#
+#   ./pipeline_bench.sh <weft build dir> [elements] [runs] [waves]
+
+set -euo pipefail
+
+if [[ $# -lt 1 ]]; then
+  echo "usage: $0 <weft build dir> [elements] [runs] [waves]" >&2
+  exit 1
+fi
+build=$(realpath "$1")
+elements=${2:-50000000}
+runs=${3:-5}
+waves=${4:-4}
+
+server=$build/backend/server
+lib=$build/frontend/libweft.so
+for file in "$server" "$lib" ./vectorAdd_nvrtc; do
+  [[ -x $file || -f $file ]] || { echo "missing $file" >&2; exit 1; }
+done
+
+log=$(mktemp -d)
+pid=
+trap '[[ -n $pid ]] && kill "$pid" 2>/dev/null; rm -rf "$log"' EXIT
+
+# Sets `median` to the median elapsed ms of `runs` runs against a server
+# started with WEFT_PIPELINE=$1 (empty for off)
+bench() {
+  WEFT_PIPELINE=$1 "$server" >"$log/server-$1.log" 2>&1 &
+  pid=$!
+  sleep 2
+  local times=()
+  for ((i = 0; i < runs; ++i)); do
+    local out
+    out=$(LD_PRELOAD=$lib ./vectorAdd_nvrtc -elements="$elements" 2>/dev/null)
+    grep -q "Test PASSED" <<<"$out" || { echo "run failed" >&2; exit 1; }
+    times+=("$(sed -n 's/^Elapsed time: //p' <<<"$out")")
+  done
+  kill "$pid"
+  wait "$pid" 2>/dev/null || true
+  pid=
+  median=$(printf '%s\n' "${times[@]}" | sort -g | sed -n "$((runs / 2 + 1))p")
+}
+
+bench ""
+serial=$median
+bench "$waves"
+pipelined=$median
+echo "vectorAdd of $elements elements, median of $runs runs:"
+echo "  serial:    $serial ms"
+echo "  $waves waves:   $pipelined ms"
+awk -v s="$serial" -v p="$pipelined" \
+  'BEGIN { printf "  speedup:   %.2fx\n", s / p }'
+grep -h "> Pipeline:" "$log/server-$waves.log" | tail -n 1 || true
@@ -45,6 +45,10 @@ int main(int argc, char **argv) {
 
   // Print the vector length to be used, and compute its size
   int numElements = 50000;
+  // Larger vectors show copies overlapping the kernel, e.g. -elements=50000000
+  if (checkCmdLineFlag(argc, (const char **)argv, "elements")) {
+    numElements = getCmdLineArgumentInt(argc, (const char **)argv, "elements");
+  }
   size_t size = numElements * sizeof(float);
   printf("[Vector addition of %d elements]\n", numElements);
 
@@ -95,25 +99,31 @@ int main(int argc, char **argv) {
   dim3 cudaBlockSize(threadsPerBlock, 1, 1);
   dim3 cudaGridSize(blocksPerGrid, 1, 1);
 
-  int _weft_blockOffset = 0;
   void *arr[] = {reinterpret_cast<void *>(&d_A), reinterpret_cast<void *>(&d_B),
                  reinterpret_cast<void *>(&d_C),
-                 reinterpret_cast<void *>(&numElements),
-                 reinterpret_cast<void *>(&_weft_blockOffset)};
+                 reinterpret_cast<void *>(&numElements)};
 
   cudaEvent_t start, stop;
   cudaEventCreate(&start);
   cudaEventCreate(&stop);
 
+  // Repeated launches measure launch throughput, e.g. -launches=1000
+  int launches = 1;
+  if (checkCmdLineFlag(argc, (const char **)argv, "launches")) {
+    launches = getCmdLineArgumentInt(argc, (const char **)argv, "launches");
+  }
+
   cudaEventRecord(start);
   auto t_start = std::chrono::high_resolution_clock::now();
-  checkCudaErrors(cuLaunchKernel(kernel_addr, cudaGridSize.x, cudaGridSize.y,
-                                 cudaGridSize.z, /* grid dim */
-                                 cudaBlockSize.x, cudaBlockSize.y,
-                                 cudaBlockSize.z, /* block dim */
-                                 0, 0,            /* shared mem, stream */
-                                 &arr[0],         /* arguments */
-                                 0));
+  for (int i = 0; i < launches; ++i) {
+    checkCudaErrors(cuLaunchKernel(kernel_addr, cudaGridSize.x, cudaGridSize.y,
+                                   cudaGridSize.z, /* grid dim */
+                                   cudaBlockSize.x, cudaBlockSize.y,
+                                   cudaBlockSize.z, /* block dim */
+                                   0, 0,            /* shared mem, stream */
+                                   &arr[0],         /* arguments */
+                                   0));
+  }
   checkCudaErrors(cuCtxSynchronize());
   cudaEventRecord(stop);
   auto t_end = std::chrono::high_resolution_clock::now();
@@ -123,6 +133,10 @@ int main(int argc, char **argv) {
   // float elapsed_time_ms = 0;
   // cudaEventElapsedTime(&elapsed_time_ms, start, stop);
   printf("Elapsed time: %f\n", elapsed_time_ms);
+  if (launches > 1) {
+    printf("Launches: %d (%f launches/s)\n", launches,
+           launches / (elapsed_time_ms / 1000));
+  }
 
   // Copy the device result vector in device memory to the host result vector
   // in host memory.
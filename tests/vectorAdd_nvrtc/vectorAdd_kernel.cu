@@ -16,9 +16,13 @@
  * number of elements numElements.
  */
 
-extern "C" __global__ void vectorAdd(const float *A, const float *B, float *C,
-                                     int numElements, int _weft_BlockOffset) {
-  int i = blockDim.x * (blockIdx.x + _weft_BlockOffset) + threadIdx.x;
+// Weft may pipeline launches over elementwise buffers, see weft/pipeline.h
+#define ELEMENTWISE __attribute__((annotate("weft_elementwise")))
+
+extern "C" __global__ void vectorAdd(ELEMENTWISE const float *A,
+                                     ELEMENTWISE const float *B,
+                                     ELEMENTWISE float *C, int numElements) {
+  int i = blockDim.x * blockIdx.x + threadIdx.x;
 
   if (i < numElements) {
     C[i] = A[i] + B[i];